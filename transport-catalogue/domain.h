@@ -16,6 +16,8 @@ namespace transport_catalog::domain
     {
         std::string name;
         geo::Coordinates coordinates;
+        // Порядковый номер остановки в справочнике, назначается при добавлении
+        size_t id = 0;
         bool operator==(const Stop &in) const
         {
             return name == in.name;
@@ -1,10 +1,166 @@
 #include "json.h"
 
+#include <algorithm>
+#include <charconv>
 #include <iterator>
 
 namespace json
 {
 
+	Node::Node(Array value)
+		: type_(Type::ARRAY)
+	{
+		payload_.array = new Array(std::move(value));
+	}
+
+	Node::Node(Dict value)
+		: type_(Type::DICT)
+	{
+		payload_.dict = new Dict(std::move(value));
+	}
+
+	Node::Node(std::string value)
+		: type_(Type::STRING)
+	{
+		payload_.string = new std::string(std::move(value));
+	}
+
+	Node::Node(const char *value)
+		: Node(std::string(value))
+	{
+	}
+
+	Node::Node(Value value)
+	{
+		*this = std::visit(
+			[](auto &&v)
+			{
+				return Node(std::move(v));
+			},
+			std::move(value));
+	}
+
+	Node::Node(const Node &other)
+		: type_(other.type_)
+	{
+		switch (type_)
+		{
+		case Type::ARRAY:
+			payload_.array = new Array(*other.payload_.array);
+			break;
+		case Type::DICT:
+			payload_.dict = new Dict(*other.payload_.dict);
+			break;
+		case Type::STRING:
+			payload_.string = new std::string(*other.payload_.string);
+			break;
+		default:
+			payload_ = other.payload_;
+			break;
+		}
+	}
+
+	Node::Node(Node &&other) noexcept
+		: payload_(other.payload_), type_(other.type_)
+	{
+		// Контейнер переходит к новому владельцу, исходный узел становится null
+		other.type_ = Type::NULL_VALUE;
+	}
+
+	Node &Node::operator=(const Node &other)
+	{
+		if (this != &other)
+		{
+			*this = Node(other);
+		}
+		return *this;
+	}
+
+	Node &Node::operator=(Node &&other) noexcept
+	{
+		if (this != &other)
+		{
+			Clear();
+			payload_ = other.payload_;
+			type_ = other.type_;
+			other.type_ = Type::NULL_VALUE;
+		}
+		return *this;
+	}
+
+	Node::~Node()
+	{
+		Clear();
+	}
+
+	void Node::Clear() noexcept
+	{
+		switch (type_)
+		{
+		case Type::ARRAY:
+			delete payload_.array;
+			break;
+		case Type::DICT:
+			delete payload_.dict;
+			break;
+		case Type::STRING:
+			delete payload_.string;
+			break;
+		default:
+			break;
+		}
+		type_ = Type::NULL_VALUE;
+	}
+
+	bool Node::operator==(const Node &rhs) const
+	{
+		if (type_ != rhs.type_)
+		{
+			return false;
+		}
+		switch (type_)
+		{
+		case Type::NULL_VALUE:
+			return true;
+		case Type::ARRAY:
+			return *payload_.array == *rhs.payload_.array;
+		case Type::DICT:
+			return *payload_.dict == *rhs.payload_.dict;
+		case Type::BOOL:
+			return payload_.boolean == rhs.payload_.boolean;
+		case Type::INT:
+			return payload_.integer == rhs.payload_.integer;
+		case Type::DOUBLE:
+			return payload_.real == rhs.payload_.real;
+		case Type::STRING:
+			return *payload_.string == *rhs.payload_.string;
+		}
+		return false;
+	}
+
+	Node::Value Node::GetValue() const
+	{
+		switch (type_)
+		{
+		case Type::ARRAY:
+			return *payload_.array;
+		case Type::DICT:
+			return *payload_.dict;
+		case Type::BOOL:
+			return payload_.boolean;
+		case Type::INT:
+			return payload_.integer;
+		case Type::DOUBLE:
+			return payload_.real;
+		case Type::STRING:
+			return *payload_.string;
+		default:
+			return nullptr;
+		}
+	}
+
+	static_assert(sizeof(Node) == 16, "json::Node must stay compact");
+
 	namespace
 	{
 		using namespace std::literals;
@@ -12,10 +168,21 @@ namespace json
 		Node LoadNode(std::istream &input);
 		Node LoadString(std::istream &input);
 
+		// Проверки символов без обращения к локали
+		bool IsDigit(int c)
+		{
+			return c >= '0' && c <= '9';
+		}
+
+		bool IsAlpha(int c)
+		{
+			return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+		}
+
 		std::string LoadLiteral(std::istream &input)
 		{
 			std::string s;
-			while (std::isalpha(input.peek()))
+			while (IsAlpha(input.peek()))
 			{
 				s.push_back(static_cast<char>(input.get()));
 			}
@@ -181,11 +348,11 @@ namespace json
 			// Считывает одну или более цифр в parsed_num из input
 			auto read_digits = [&input, read_char]
 			{
-				if (!std::isdigit(input.peek()))
+				if (!IsDigit(input.peek()))
 				{
 					throw ParsingError("A digit is expected"s);
 				}
-				while (std::isdigit(input.peek()))
+				while (IsDigit(input.peek()))
 				{
 					read_char();
 				}
@@ -227,27 +394,25 @@ namespace json
 				is_int = false;
 			}
 
-			try
+			const char *first = parsed_num.data();
+			const char *last = first + parsed_num.size();
+			if (is_int)
 			{
-				if (is_int)
+				// Сначала пробуем преобразовать строку в int
+				int value = 0;
+				if (const auto [ptr, ec] = std::from_chars(first, last, value); ec == std::errc{} && ptr == last)
 				{
-					// Сначала пробуем преобразовать строку в int
-					try
-					{
-						return std::stoi(parsed_num);
-					}
-					catch (...)
-					{
-						// В случае неудачи, например, при переполнении
-						// код ниже попробует преобразовать строку в double
-					}
+					return value;
 				}
-				return std::stod(parsed_num);
+				// В случае неудачи, например, при переполнении
+				// код ниже попробует преобразовать строку в double
 			}
-			catch (...)
+			double value = 0.0;
+			if (const auto [ptr, ec] = std::from_chars(first, last, value); ec == std::errc{} && ptr == last)
 			{
-				throw ParsingError("Failed to convert "s + parsed_num + " to number"s);
+				return value;
 			}
+			throw ParsingError("Failed to convert "s + parsed_num + " to number"s);
 		}
 
 		Node LoadNode(std::istream &input)
@@ -285,59 +450,164 @@ namespace json
 			}
 		}
 
+		bool IsSpace(int c)
+		{
+			return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+		}
+
+		// Пропускает пробельные символы и возвращает следующий символ, не извлекая его
+		int SkipSpaces(std::streambuf &buf)
+		{
+			int c = buf.sgetc();
+			while (c != EOF && IsSpace(c))
+			{
+				c = buf.snextc();
+			}
+			return c;
+		}
+
+		// Копирует в raw содержимое строки вместе с закрывающей кавычкой
+		void ScanString(std::streambuf &buf, std::string &raw)
+		{
+			while (true)
+			{
+				const int c = buf.sbumpc();
+				if (c == EOF)
+				{
+					throw ParsingError("String parsing error"s);
+				}
+				raw.push_back(static_cast<char>(c));
+				if (c == '"')
+				{
+					return;
+				}
+				if (c == '\\')
+				{
+					const int escaped = buf.sbumpc();
+					if (escaped == EOF)
+					{
+						throw ParsingError("String parsing error"s);
+					}
+					raw.push_back(static_cast<char>(escaped));
+				}
+			}
+		}
+
+		// Копирует в raw текст очередного значения, не разбирая его.
+		// Отслеживается только вложенность скобок и границы строк
+		void ScanValue(std::streambuf &buf, std::string &raw)
+		{
+			int depth = 0;
+			SkipSpaces(buf);
+			while (true)
+			{
+				const int c = buf.sgetc();
+				if (c == EOF)
+				{
+					if (depth > 0)
+					{
+						throw ParsingError("Unexpected EOF"s);
+					}
+					return;
+				}
+				if (depth == 0 && (c == ',' || c == '}' || c == ']' || IsSpace(c)))
+				{
+					// Конец скалярного значения
+					return;
+				}
+				raw.push_back(static_cast<char>(buf.sbumpc()));
+				if (c == '"')
+				{
+					ScanString(buf, raw);
+				}
+				else if (c == '[' || c == '{')
+				{
+					++depth;
+				}
+				else if (c == ']' || c == '}')
+				{
+					--depth;
+				}
+				if (depth == 0 && (c == '"' || c == ']' || c == '}'))
+				{
+					return;
+				}
+			}
+		}
+
+		// Позволяет читать участок памяти через std::istream без копирования
+		class MemoryBuffer : public std::streambuf
+		{
+		public:
+			MemoryBuffer(const char *begin, const char *end)
+			{
+				char *data = const_cast<char *>(begin);
+				setg(data, data, const_cast<char *>(end));
+			}
+		};
+
 		struct PrintContext
 		{
-			std::ostream &out;
-			int indent_step = 4;
+			OutputSink &out;
+			const PrintSettings &settings;
 			int indent = 0;
 
 			void PrintIndent() const
 			{
 				for (int i = 0; i < indent; ++i)
 				{
-					out.put(' ');
+					out.Put(' ');
+				}
+			}
+
+			// Выводит разделитель перед очередным элементом контейнера
+			void PrintItemSeparator(bool first) const
+			{
+				if (settings.pretty)
+				{
+					out.Write(first ? "\n"sv : ",\n"sv);
+					PrintIndent();
+				}
+				else if (!first)
+				{
+					out.Put(',');
 				}
 			}
 
+			// Выводит закрывающую скобку контейнера, ctx — контекст самого контейнера
+			void PrintClose(char bracket, bool empty) const
+			{
+				if (settings.pretty)
+				{
+					out.Write(empty ? "\n\n"sv : "\n"sv);
+					PrintIndent();
+				}
+				out.Put(bracket);
+			}
+
 			PrintContext Indented() const
 			{
-				return {out, indent_step, indent_step + indent};
+				return {out, settings, settings.indent_step + indent};
 			}
 		};
 
 		void PrintNode(const Node &value, const PrintContext &ctx);
 
 		template <typename Value>
-		void PrintValue(const Value &value, const PrintContext &ctx)
+		void PrintValue(const Value &value, const PrintContext &ctx);
+
+		template <>
+		void PrintValue<int>(const int &value, const PrintContext &ctx)
 		{
-			ctx.out << value;
+			char buffer[MAX_NUMBER_LENGTH];
+			ctx.out.Write({buffer, static_cast<size_t>(FormatNumber(buffer, value) - buffer)});
 		}
 
-		void PrintString(const std::string &value, std::ostream &out)
+		template <>
+		void PrintValue<double>(const double &value, const PrintContext &ctx)
 		{
-			out.put('"');
-			for (const char c : value)
-			{
-				switch (c)
-				{
-				case '\r':
-					out << "\\r"sv;
-					break;
-				case '\n':
-					out << "\\n"sv;
-					break;
-				case '"':
-					// Символы " и \ выводятся как \" или \\, соответственно
-					[[fallthrough]];
-				case '\\':
-					out.put('\\');
-					[[fallthrough]];
-				default:
-					out.put(c);
-					break;
-				}
-			}
-			out.put('"');
+			char buffer[MAX_NUMBER_LENGTH];
+			ctx.out.Write({buffer, static_cast<size_t>(FormatNumber(buffer, value, ctx.settings.double_precision) - buffer)});
 		}
 
 		template <>
@@ -349,7 +619,7 @@ namespace json
 		template <>
 		void PrintValue<std::nullptr_t>(const std::nullptr_t &, const PrintContext &ctx)
 		{
-			ctx.out << "null"sv;
+			ctx.out.Write("null"sv);
 		}
 
 		// В специализаци шаблона PrintValue для типа bool параметр value передаётся
@@ -359,69 +629,67 @@ namespace json
 		template <>
 		void PrintValue<bool>(const bool &value, const PrintContext &ctx)
 		{
-			ctx.out << (value ? "true"sv : "false"sv);
+			ctx.out.Write(value ? "true"sv : "false"sv);
 		}
 
 		template <>
 		void PrintValue<Array>(const Array &nodes, const PrintContext &ctx)
 		{
-			std::ostream &out = ctx.out;
-			out << "[\n"sv;
+			ctx.out.Put('[');
 			bool first = true;
 			auto inner_ctx = ctx.Indented();
 			for (const Node &node : nodes)
 			{
-				if (first)
-				{
-					first = false;
-				}
-				else
-				{
-					out << ",\n"sv;
-				}
-				inner_ctx.PrintIndent();
+				inner_ctx.PrintItemSeparator(first);
+				first = false;
 				PrintNode(node, inner_ctx);
 			}
-			out.put('\n');
-			ctx.PrintIndent();
-			out.put(']');
+			ctx.PrintClose(']', nodes.empty());
 		}
 
 		template <>
 		void PrintValue<Dict>(const Dict &nodes, const PrintContext &ctx)
 		{
-			std::ostream &out = ctx.out;
-			out << "{\n"sv;
+			ctx.out.Put('{');
 			bool first = true;
 			auto inner_ctx = ctx.Indented();
 			for (const auto &[key, node] : nodes)
 			{
-				if (first)
-				{
-					first = false;
-				}
-				else
-				{
-					out << ",\n"sv;
-				}
-				inner_ctx.PrintIndent();
+				inner_ctx.PrintItemSeparator(first);
+				first = false;
 				PrintString(key, ctx.out);
-				out << ": "sv;
+				ctx.out.Write(ctx.settings.pretty ? ": "sv : ":"sv);
 				PrintNode(node, inner_ctx);
 			}
-			out.put('\n');
-			ctx.PrintIndent();
-			out.put('}');
+			ctx.PrintClose('}', nodes.empty());
 		}
 
 		void PrintNode(const Node &node, const PrintContext &ctx)
 		{
-			std::visit(
-				[&ctx](const auto &value)
-				{
-					PrintValue(value, ctx);
-				},
-				node.GetValue());
+			switch (node.GetType())
+			{
+			case Node::Type::NULL_VALUE:
+				PrintValue(nullptr, ctx);
+				break;
+			case Node::Type::ARRAY:
+				PrintValue(node.AsArray(), ctx);
+				break;
+			case Node::Type::DICT:
+				PrintValue(node.AsDict(), ctx);
+				break;
+			case Node::Type::BOOL:
+				PrintValue(node.AsBool(), ctx);
+				break;
+			case Node::Type::INT:
+				PrintValue(node.AsInt(), ctx);
+				break;
+			case Node::Type::DOUBLE:
+				PrintValue(node.AsDouble(), ctx);
+				break;
+			case Node::Type::STRING:
+				PrintValue(node.AsString(), ctx);
+				break;
+			}
 		}
 
 	} // namespace
@@ -431,9 +699,307 @@ namespace json
 		return Document{LoadNode(input)};
 	}
 
+	Document Load(std::string_view text)
+	{
+		MemoryBuffer buf(text.data(), text.data() + text.size());
+		std::istream input(&buf);
+		return Load(input);
+	}
+
+	SectionReader::SectionReader(std::istream &input)
+		: input_(input)
+	{
+		if (SkipSpaces(*input_.rdbuf()) != '{')
+		{
+			throw ParsingError("Root dictionary is expected"s);
+		}
+		input_.rdbuf()->sbumpc();
+	}
+
+	bool SectionReader::NextKey(std::string &key)
+	{
+		std::streambuf &buf = *input_.rdbuf();
+		int c = SkipSpaces(buf);
+		if (!first_ && c == ',')
+		{
+			buf.sbumpc();
+			c = SkipSpaces(buf);
+		}
+		else if (c == '}')
+		{
+			buf.sbumpc();
+			return false;
+		}
+		else if (!first_)
+		{
+			throw ParsingError("',' is expected in the root dictionary"s);
+		}
+		if (c != '"')
+		{
+			throw ParsingError("Section key is expected"s);
+		}
+		buf.sbumpc();
+		key = LoadString(input_).AsString();
+		if (SkipSpaces(buf) != ':')
+		{
+			throw ParsingError("':' is expected after '"s + key + "'"s);
+		}
+		buf.sbumpc();
+		first_ = false;
+		return true;
+	}
+
+	void SectionReader::SkipValue(std::string &text)
+	{
+		ScanValue(*input_.rdbuf(), text);
+	}
+
+	Node SectionReader::LoadValue()
+	{
+		return LoadNode(input_);
+	}
+
+	void SectionReader::ReadArray(const std::function<void(Node &&)> &callback)
+	{
+		std::streambuf &buf = *input_.rdbuf();
+		if (SkipSpaces(buf) != '[')
+		{
+			throw ParsingError("Array is expected"s);
+		}
+		buf.sbumpc();
+		bool first = true;
+		while (true)
+		{
+			int c = SkipSpaces(buf);
+			if (c == ']')
+			{
+				buf.sbumpc();
+				return;
+			}
+			if (!first)
+			{
+				if (c != ',')
+				{
+					throw ParsingError("Array parsing error"s);
+				}
+				buf.sbumpc();
+			}
+			first = false;
+			callback(LoadNode(input_));
+		}
+	}
+
+	LazyDocument::LazyDocument(std::istream &input)
+	{
+		SectionReader reader(input);
+		for (std::string key; reader.NextKey(key);)
+		{
+			AddSection(std::move(key), reader);
+		}
+	}
+
+	void LazyDocument::AddSection(std::string key, SectionReader &reader)
+	{
+		if (sections_.count(key) > 0)
+		{
+			throw ParsingError("Duplicate key '"s + key + "' have been found"s);
+		}
+		Section section;
+		section.begin = text_.size();
+		reader.SkipValue(text_);
+		section.end = text_.size();
+		sections_.emplace(std::move(key), std::move(section));
+	}
+
+	bool LazyDocument::Has(std::string_view key) const
+	{
+		return sections_.find(key) != sections_.end();
+	}
+
+	const Node &LazyDocument::At(std::string_view key) const
+	{
+		const auto it = sections_.find(key);
+		if (it == sections_.end())
+		{
+			throw std::out_of_range("No section '"s + std::string(key) + "'"s);
+		}
+		const Section &section = it->second;
+		std::lock_guard lock(parse_mutex_);
+		if (!section.node)
+		{
+			MemoryBuffer buf(text_.data() + section.begin, text_.data() + section.end);
+			std::istream input(&buf);
+			section.node = LoadNode(input);
+		}
+		return *section.node;
+	}
+
+	char *FormatNumber(char *buffer, int value)
+	{
+		return std::to_chars(buffer, buffer + MAX_NUMBER_LENGTH, value).ptr;
+	}
+
+	char *FormatNumber(char *buffer, double value, int precision)
+	{
+		if (precision > 0)
+		{
+			// Совпадает с выводом ostream::operator<< при precision() == precision.
+			// Больше 17 значащих цифр double не содержит
+			return std::to_chars(buffer, buffer + MAX_NUMBER_LENGTH, value, std::chars_format::general, std::min(precision, 17)).ptr;
+		}
+		return std::to_chars(buffer, buffer + MAX_NUMBER_LENGTH, value).ptr;
+	}
+
+	OutputSink::OutputSink(std::ostream &out, size_t capacity)
+		: out_(&out), buffer_(std::max<size_t>(capacity, 1))
+	{
+	}
+
+	OutputSink::OutputSink(std::string &out, size_t capacity)
+		: text_(&out), buffer_(std::max<size_t>(capacity, 1))
+	{
+	}
+
+	OutputSink::~OutputSink()
+	{
+		Drain();
+	}
+
+	void OutputSink::Write(std::string_view data)
+	{
+		if (data.size() > buffer_.size() - size_)
+		{
+			Drain();
+			if (data.size() >= buffer_.size())
+			{
+				// Большой блок не имеет смысла копировать в буфер
+				if (text_)
+				{
+					text_->append(data);
+				}
+				else
+				{
+					out_->write(data.data(), data.size());
+				}
+				return;
+			}
+		}
+		std::copy(data.begin(), data.end(), buffer_.begin() + size_);
+		size_ += data.size();
+	}
+
+	void OutputSink::Flush()
+	{
+		Drain();
+		if (out_)
+		{
+			out_->flush();
+		}
+	}
+
+	void OutputSink::Drain()
+	{
+		if (size_ > 0)
+		{
+			if (text_)
+			{
+				text_->append(buffer_.data(), size_);
+			}
+			else
+			{
+				out_->write(buffer_.data(), size_);
+			}
+			size_ = 0;
+		}
+	}
+
 	void Print(const Document &doc, std::ostream &output)
 	{
-		PrintNode(doc.GetRoot(), PrintContext{output});
+		Print(doc, output, PrintSettings{});
+	}
+
+	void PrintString(std::string_view value, OutputSink &out)
+	{
+		out.Put('"');
+		PrintEscaped(value, out);
+		out.Put('"');
+	}
+
+	void PrintEscaped(std::string_view value, OutputSink &out)
+	{
+		// Участки без спецсимволов копируются в буфер целиком
+		size_t run_begin = 0;
+		for (size_t i = 0; i < value.size(); ++i)
+		{
+			std::string_view escaped;
+			switch (value[i])
+			{
+			case '\r':
+				escaped = "\\r"sv;
+				break;
+			case '\n':
+				escaped = "\\n"sv;
+				break;
+			case '"':
+				// Символы " и \ выводятся как \" или \\, соответственно
+				escaped = "\\\""sv;
+				break;
+			case '\\':
+				escaped = "\\\\"sv;
+				break;
+			default:
+				continue;
+			}
+			out.Write(value.substr(run_begin, i - run_begin));
+			out.Write(escaped);
+			run_begin = i + 1;
+		}
+		out.Write(value.substr(run_begin));
+	}
+
+	EscapingStreambuf::EscapingStreambuf(OutputSink &out)
+		: out_(out)
+	{
+		setp(buffer_, buffer_ + BUFFER_SIZE);
+	}
+
+	EscapingStreambuf::~EscapingStreambuf()
+	{
+		Drain();
+	}
+
+	EscapingStreambuf::int_type EscapingStreambuf::overflow(int_type c)
+	{
+		Drain();
+		if (!traits_type::eq_int_type(c, traits_type::eof()))
+		{
+			*pptr() = traits_type::to_char_type(c);
+			pbump(1);
+		}
+		return traits_type::not_eof(c);
+	}
+
+	int EscapingStreambuf::sync()
+	{
+		Drain();
+		return 0;
+	}
+
+	void EscapingStreambuf::Drain()
+	{
+		PrintEscaped({pbase(), static_cast<size_t>(pptr() - pbase())}, out_);
+		setp(buffer_, buffer_ + BUFFER_SIZE);
+	}
+
+	void Print(const Document &doc, OutputSink &output, const PrintSettings &settings)
+	{
+		PrintNode(doc.GetRoot(), PrintContext{output, settings});
+	}
+
+	void Print(const Document &doc, std::ostream &output, const PrintSettings &settings)
+	{
+		OutputSink sink(output);
+		Print(doc, sink, settings);
 	}
 
 } // namespace json
\ No newline at end of file
@@ -1,8 +1,15 @@
 #pragma once
 
+#include <cstdint>
+#include <functional>
 #include <iostream>
 #include <map>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <streambuf>
 #include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 
@@ -19,16 +26,68 @@ namespace json
 		using runtime_error::runtime_error;
 	};
 
+	/*
+	 * Узел JSON занимает 16 байт: тег типа и объединение, в котором скалярные
+	 * значения хранятся на месте, а строки и контейнеры вынесены в кучу.
+	 * Благодаря этому массивы чисел и запросов лежат в памяти плотно.
+	 */
 	class Node final
-		: private std::variant<std::nullptr_t, Array, Dict, bool, int, double, std::string>
 	{
 	public:
-		using variant::variant;
-		using Value = variant;
+		using Value = std::variant<std::nullptr_t, Array, Dict, bool, int, double, std::string>;
+
+		enum class Type : std::uint8_t
+		{
+			NULL_VALUE,
+			ARRAY,
+			DICT,
+			BOOL,
+			INT,
+			DOUBLE,
+			STRING,
+		};
+
+		Node() noexcept
+		{
+		}
+		Node(std::nullptr_t) noexcept
+		{
+		}
+		Node(bool value) noexcept
+			: type_(Type::BOOL)
+		{
+			payload_.boolean = value;
+		}
+		Node(int value) noexcept
+			: type_(Type::INT)
+		{
+			payload_.integer = value;
+		}
+		Node(double value) noexcept
+			: type_(Type::DOUBLE)
+		{
+			payload_.real = value;
+		}
+		Node(Array value);
+		Node(Dict value);
+		Node(std::string value);
+		Node(const char *value);
+		Node(Value value);
+
+		Node(const Node &other);
+		Node(Node &&other) noexcept;
+		Node &operator=(const Node &other);
+		Node &operator=(Node &&other) noexcept;
+		~Node();
+
+		Type GetType() const
+		{
+			return type_;
+		}
 
 		bool IsInt() const
 		{
-			return std::holds_alternative<int>(*this);
+			return type_ == Type::INT;
 		}
 		int AsInt() const
 		{
@@ -37,12 +96,12 @@ namespace json
 			{
 				throw std::logic_error("Not an int"s);
 			}
-			return std::get<int>(*this);
+			return payload_.integer;
 		}
 
 		bool IsPureDouble() const
 		{
-			return std::holds_alternative<double>(*this);
+			return type_ == Type::DOUBLE;
 		}
 		bool IsDouble() const
 		{
@@ -55,12 +114,12 @@ namespace json
 			{
 				throw std::logic_error("Not a double"s);
 			}
-			return IsPureDouble() ? std::get<double>(*this) : AsInt();
+			return IsPureDouble() ? payload_.real : payload_.integer;
 		}
 
 		bool IsBool() const
 		{
-			return std::holds_alternative<bool>(*this);
+			return type_ == Type::BOOL;
 		}
 		bool AsBool() const
 		{
@@ -70,17 +129,17 @@ namespace json
 				throw std::logic_error("Not a bool"s);
 			}
 
-			return std::get<bool>(*this);
+			return payload_.boolean;
 		}
 
 		bool IsNull() const
 		{
-			return std::holds_alternative<std::nullptr_t>(*this);
+			return type_ == Type::NULL_VALUE;
 		}
 
 		bool IsArray() const
 		{
-			return std::holds_alternative<Array>(*this);
+			return type_ == Type::ARRAY;
 		}
 		const Array &AsArray() const
 		{
@@ -90,12 +149,12 @@ namespace json
 				throw std::logic_error("Not an array"s);
 			}
 
-			return std::get<Array>(*this);
+			return *payload_.array;
 		}
 
 		bool IsString() const
 		{
-			return std::holds_alternative<std::string>(*this);
+			return type_ == Type::STRING;
 		}
 		const std::string &AsString() const
 		{
@@ -105,12 +164,12 @@ namespace json
 				throw std::logic_error("Not a string"s);
 			}
 
-			return std::get<std::string>(*this);
+			return *payload_.string;
 		}
 
 		bool IsDict() const
 		{
-			return std::holds_alternative<Dict>(*this);
+			return type_ == Type::DICT;
 		}
 		const Dict &AsDict() const
 		{
@@ -120,18 +179,29 @@ namespace json
 				throw std::logic_error("Not a dict"s);
 			}
 
-			return std::get<Dict>(*this);
+			return *payload_.dict;
 		}
 
-		bool operator==(const Node &rhs) const
-		{
-			return GetValue() == rhs.GetValue();
-		}
+		bool operator==(const Node &rhs) const;
+
+		// Копия значения в виде std::variant (для совместимости со старым интерфейсом)
+		Value GetValue() const;
 
-		const Value &GetValue() const
+	private:
+		void Clear() noexcept;
+
+		union Payload
 		{
-			return *this;
-		}
+			bool boolean;
+			int integer;
+			double real;
+			Array *array;
+			Dict *dict;
+			std::string *string;
+		};
+
+		Payload payload_{};
+		Type type_ = Type::NULL_VALUE;
 	};
 
 	inline bool operator!=(const Node &lhs, const Node &rhs)
@@ -167,7 +237,154 @@ namespace json
 	}
 
 	Document Load(std::istream &input);
+	// Разбирает документ из строки без копирования её в поток
+	Document Load(std::string_view text);
+
+	/*
+	 * Последовательно читает разделы корневого словаря из потока.
+	 * Значение каждого раздела можно разобрать или пропустить, не строя узлов
+	 */
+	class SectionReader
+	{
+	public:
+		explicit SectionReader(std::istream &input);
+
+		// Читает ключ очередного раздела. Возвращает false, когда словарь закончился
+		bool NextKey(std::string &key);
+		// Дописывает текст значения текущего раздела в text без разбора
+		void SkipValue(std::string &text);
+		Node LoadValue();
+		// Разбирает массив текущего раздела поэлементно, передавая
+		// каждый элемент в callback сразу после его разбора. Элемент передаётся
+		// во владение callback без копирования
+		void ReadArray(const std::function<void(Node &&)> &callback);
+
+	private:
+		std::istream &input_;
+		bool first_ = true;
+	};
+
+	/*
+	 * Документ с ленивым разбором. При загрузке разделы корневого словаря
+	 * только индексируются по диапазонам байт, а разбираются при первом обращении
+	 */
+	class LazyDocument
+	{
+	public:
+		LazyDocument() = default;
+		explicit LazyDocument(std::istream &input);
+
+		// Сохраняет текст текущего раздела reader под ключом key
+		void AddSection(std::string key, SectionReader &reader);
+
+		bool Has(std::string_view key) const;
+		// Бросает std::out_of_range, если раздела нет.
+		// Можно вызывать из нескольких потоков одновременно
+		const Node &At(std::string_view key) const;
+
+	private:
+		struct Section
+		{
+			size_t begin = 0;
+			size_t end = 0;
+			mutable std::optional<Node> node;
+		};
+
+		std::string text_;
+		std::map<std::string, Section, std::less<>> sections_;
+		mutable std::mutex parse_mutex_;
+	};
+
+	// Настройки вывода JSON
+	struct PrintSettings
+	{
+		// false — компактный вывод без переводов строк и отступов
+		bool pretty = true;
+		int indent_step = 4;
+		// Число значащих цифр для double; 0 — кратчайшая запись, однозначно читаемая обратно
+		int double_precision = 6;
+	};
+
+	// Размер буфера, достаточный для записи любого числа через FormatNumber
+	inline constexpr size_t MAX_NUMBER_LENGTH = 32;
+
+	// Записывают число в buffer без учёта локали и возвращают указатель на конец записи
+	char *FormatNumber(char *buffer, int value);
+	char *FormatNumber(char *buffer, double value, int precision);
+
+	/*
+	 * Буферизованный приёмник вывода. Накапливает данные в большом буфере
+	 * и передаёт их в поток крупными блоками, а не по одному символу.
+	 */
+	class OutputSink
+	{
+	public:
+		static constexpr size_t DEFAULT_CAPACITY = 1 << 16;
+
+		explicit OutputSink(std::ostream &out, size_t capacity = DEFAULT_CAPACITY);
+		// Дописывает вывод в конец строки out
+		explicit OutputSink(std::string &out, size_t capacity = DEFAULT_CAPACITY);
+		OutputSink(const OutputSink &) = delete;
+		OutputSink &operator=(const OutputSink &) = delete;
+		~OutputSink();
+
+		void Put(char c)
+		{
+			if (size_ == buffer_.size())
+			{
+				Drain();
+			}
+			buffer_[size_++] = c;
+		}
+
+		void Write(std::string_view data);
+
+		// Передаёт накопленные данные в поток и сбрасывает его
+		void Flush();
+
+	private:
+		void Drain();
+
+		std::ostream *out_ = nullptr;
+		std::string *text_ = nullptr;
+		std::vector<char> buffer_;
+		size_t size_ = 0;
+	};
+
+	// Выводит строку в кавычках, экранируя спецсимволы
+	void PrintString(std::string_view value, OutputSink &out);
+	// Выводит содержимое строки без кавычек, экранируя спецсимволы
+	void PrintEscaped(std::string_view value, OutputSink &out);
+
+	/*
+	 * Буфер потока, который экранирует записанный в поток текст как содержимое
+	 * JSON-строки и передаёт его в OutputSink участками по размеру буфера.
+	 * Позволяет выводить в поток сразу значение JSON-строки, без промежуточного
+	 * текста. Кавычки вокруг строки не выводятся
+	 */
+	class EscapingStreambuf final : public std::streambuf
+	{
+	public:
+		static constexpr size_t BUFFER_SIZE = 1 << 12;
+
+		explicit EscapingStreambuf(OutputSink &out);
+		EscapingStreambuf(const EscapingStreambuf &) = delete;
+		EscapingStreambuf &operator=(const EscapingStreambuf &) = delete;
+		~EscapingStreambuf() override;
+
+	protected:
+		int_type overflow(int_type c) override;
+		int sync() override;
+
+	private:
+		void Drain();
+
+		OutputSink &out_;
+		char buffer_[BUFFER_SIZE];
+	};
 
 	void Print(const Document &doc, std::ostream &output);
+	void Print(const Document &doc, std::ostream &output, const PrintSettings &settings);
+	void Print(const Document &doc, OutputSink &output, const PrintSettings &settings);
 
 } // namespace json
\ No newline at end of file
@@ -90,22 +90,22 @@ namespace json
         return b_.Key(s);
     }
 
-    StartDictContext KeyContext::Value(Node::Value v)
+    StartDictContext KeyContext::Value(Node v)
     {
-        return b_.Value(v, 3);
+        return b_.Value(std::move(v), 3);
     }
 
-    StartArrayContext StartArrayContext::Value(Node::Value v)
+    StartArrayContext StartArrayContext::Value(Node v)
     {
-        return b_.Value(v, 2);
+        return b_.Value(std::move(v), 2);
     }
 
-    Builder &Builder::Value(Node::Value v, int is_)
+    Builder &Builder::Value(Node v, int is_)
     {
         CheckComplete();
         if (is_ == 1)
         {
-            const_cast<Node::Value &>(root_.GetValue()) = std::move(v);
+            root_ = std::move(v);
             nodes_stack_.pop_back();
             if (nodes_stack_.size() == 0)
             {
@@ -115,9 +115,7 @@ namespace json
         else if (is_ == 2)
         {
             CheckComplete();
-            Node tmp;
-            const_cast<Node::Value &>(tmp.GetValue()) = std::move(v);
-            const_cast<Array &>(nodes_stack_.back()->AsArray()).emplace_back(std::move(tmp));
+            const_cast<Array &>(nodes_stack_.back()->AsArray()).emplace_back(std::move(v));
             if (nodes_stack_.size() == 0)
             {
                 complete = true;
@@ -126,7 +124,7 @@ namespace json
         else if (is_ == 3)
         {
             CheckComplete();
-            const_cast<Node::Value &>((*nodes_stack_.back()).GetValue()) = std::move(v);
+            *nodes_stack_.back() = std::move(v);
             nodes_stack_.pop_back();
             if (nodes_stack_.size() == 0)
             {
@@ -14,7 +14,7 @@ namespace json
     public:
         const std::vector<Node *> &GetNodesStack() const;
         KeyContext Key(const std::string &s);
-        Builder &Value(Node::Value v , int is_ = 1 );
+        Builder &Value(Node v, int is_ = 1);
         StartDictContext StartDict();
         StartArrayContext StartArray();
         Builder &EndDict();
@@ -33,7 +33,7 @@ namespace json
     {
     public:
         KeyContext(Builder &b) : b_(b) {}
-        StartDictContext Value(Node::Value v);
+        StartDictContext Value(Node v);
         KeyContext Key(const std::string &s) = delete;
         Node Build() = delete;
         Builder &EndDict() = delete;
@@ -47,7 +47,7 @@ namespace json
     {
     public:
         StartDictContext(Builder &b) : b_(b) {}
-        Builder Value(Node::Value v) = delete;
+        Builder Value(Node v) = delete;
         KeyContext Key(const std::string &s);
         StartDictContext StartDict() = delete;
         StartArrayContext StartArray() = delete;
@@ -63,7 +63,7 @@ namespace json
     {
     public:
         StartArrayContext(Builder &b) : b_(b) {}
-        StartArrayContext Value(Node::Value v);
+        StartArrayContext Value(Node v);
         KeyContext Key(const std::string &s) = delete;
         Node Build() = delete;
         Builder &EndDict() = delete;
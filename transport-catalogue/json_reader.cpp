@@ -1,191 +1,781 @@
 #include "json_reader.h"
 #include <algorithm>
 #include <cassert>
+#include <deque>
+#include <exception>
+#include <future>
 
 namespace transport_catalog::json_reader
 {
-    JsonReader::JsonReader(std::istream &it) : document_json_(json::Load(it))
+    JsonReader::JsonReader(std::istream &it, const json::PrintSettings &print_settings)
+        : print_settings_(print_settings)
     {
-        BaseRequest();
-        StatRequest();
+        RegisterHandlers();
+        json::SectionReader reader(it);
+        bool answered = false;
+        for (std::string key; reader.NextKey(key);)
+        {
+            // Если база и настройки отрисовки уже прочитаны, запросы
+            // обрабатываются по мере поступления, не дожидаясь конца ввода
+            if (key == "stat_requests" && !answered && document_json_.Has("base_requests") && document_json_.Has("render_settings"))
+            {
+                BaseRequest();
+                StreamStatRequest(reader, it);
+                answered = true;
+            }
+            else
+            {
+                document_json_.AddSection(std::move(key), reader);
+            }
+        }
+        if (!answered)
+        {
+            BaseRequest();
+            StatRequest();
+        }
+    }
+
+    void JsonReader::RegisterHandlers()
+    {
+        using request_handler::StatRequest;
+        request_handler_.Register("Stop", [this](const StatRequest &request, json::Writer &writer)
+                                  { RenderStop(writer, request); });
+        request_handler_.Register("Bus", [this](const StatRequest &request, json::Writer &writer)
+                                  { RenderBus(writer, request); });
+        request_handler_.Register(
+            "Map", [this](const StatRequest &request, json::Writer &writer)
+            { RenderMap(writer, request); },
+            request_handler::CostClass::Render);
+        request_handler_.Register(
+            "MapTile", [this](const StatRequest &request, json::Writer &writer)
+            { RenderMapTile(writer, request); },
+            request_handler::CostClass::Render);
+    }
+
+    namespace
+    {
+        // Возвращает SVG, который render выводит в поток, в виде JSON-строки.
+        // Текст экранируется по мере вывода, без промежуточной копии SVG
+        template <typename Render>
+        std::string RenderEscaped(Render render)
+        {
+            std::string escaped;
+            json::OutputSink sink(escaped);
+            sink.Put('"');
+            {
+                json::EscapingStreambuf buffer(sink);
+                std::ostream out(&buffer);
+                render(out);
+            }
+            sink.Put('"');
+            sink.Flush();
+            return escaped;
+        }
+    }
+
+    inline void JsonReader::RenderMap(json::Writer &writer, const request_handler::StatRequest &request)
+    {
+        if (request.params && (request.params->count("buses") > 0 || request.params->count("stops") > 0))
+        {
+            RenderMapSubset(writer, request);
+            return;
+        }
+        const auto state = GetMapState();
+        std::call_once(state->map_once, [this, &state]
+                       { state->map_json = RenderEscaped([this, &state](std::ostream &out)
+                                                         {
+                if (state->renderer)
+                {
+                    state->renderer->RenderMap(out, &Pool());
+                }
+                else
+                {
+                    svg::Document().Render(out);
+                } }); });
+        writer.Key("map").RawValue({state->map_json});
+    }
+
+    // Часть карты задаётся массивом названий маршрутов buses и массивом stops:
+    // с каждой остановкой на карту попадают все проходящие через неё маршруты.
+    // С "fit": true карта масштабируется по выбранным маршрутам
+    inline void JsonReader::RenderMapSubset(json::Writer &writer, const request_handler::StatRequest &request)
+    {
+        const json::Dict &params = *request.params;
+        std::vector<const domain::Bus *> buses;
+        bool is_valid = true;
+        bool is_found = true;
+        const auto for_each_name = [&params, &is_valid](const char *key, auto func)
+        {
+            const auto it = params.find(key);
+            if (it == params.end())
+            {
+                return;
+            }
+            if (!it->second.IsArray())
+            {
+                is_valid = false;
+                return;
+            }
+            for (const auto &name : it->second.AsArray())
+            {
+                if (!name.IsString())
+                {
+                    is_valid = false;
+                    return;
+                }
+                func(name.AsString());
+            }
+        };
+        for_each_name("buses", [&](const std::string &name)
+                      {
+                          const auto &all_buses = transport_catalog_.GetAllBus();
+                          if (const auto it = all_buses.find(name); it != all_buses.end())
+                          {
+                              buses.push_back(it->second);
+                          }
+                          else
+                          {
+                              is_found = false;
+                          } });
+        for_each_name("stops", [&](const std::string &name)
+                      {
+                          if (transport_catalog_.GetAllStop().count(name) == 0)
+                          {
+                              is_found = false;
+                              return;
+                          }
+                          const auto &stop_to_buses = transport_catalog_.StopToBus();
+                          if (const auto it = stop_to_buses.find(name); it != stop_to_buses.end())
+                          {
+                              for (const auto bus_name : it->second)
+                              {
+                                  buses.push_back(transport_catalog_.FindBus(bus_name));
+                              }
+                          } });
+        const auto fit = params.find("fit");
+        if (fit != params.end() && !fit->second.IsBool())
+        {
+            is_valid = false;
+        }
+        if (!is_valid)
+        {
+            writer.Key("error_message").Value("invalid map request");
+            return;
+        }
+        if (!is_found)
+        {
+            writer.Key("error_message").Value("not found");
+            return;
+        }
+
+        const auto state = GetMapState();
+        const bool fit_subset = fit != params.end() && fit->second.AsBool();
+        writer.Key("map").RawValue({RenderEscaped([&](std::ostream &out)
+                                                  {
+            if (state->renderer)
+            {
+                state->renderer->RenderSubset(out, buses, fit_subset, &Pool());
+            }
+            else
+            {
+                svg::Document().Render(out);
+            } })});
+    }
+
+    // Плитка задаётся полями z, x, y или массивом bbox [min_x, min_y, max_x, max_y]
+    // в координатах полной карты
+    inline void JsonReader::RenderMapTile(json::Writer &writer, const request_handler::StatRequest &request)
+    {
+        const auto state = GetMapState();
+        const json::Dict &params = *request.params;
+        const auto number = [&params](const char *key) -> const json::Node *
+        {
+            const auto it = params.find(key);
+            return it != params.end() && (it->second.IsInt() || it->second.IsDouble()) ? &it->second : nullptr;
+        };
+
+        std::string key;
+        std::optional<svgreader::Viewport> viewport;
+        if (const auto bbox = params.find("bbox"); bbox != params.end())
+        {
+            if (bbox->second.IsArray() && bbox->second.AsArray().size() == 4 &&
+                std::all_of(bbox->second.AsArray().begin(), bbox->second.AsArray().end(), [](const json::Node &value)
+                            { return value.IsInt() || value.IsDouble(); }))
+            {
+                const auto &box = bbox->second.AsArray();
+                viewport = svgreader::Viewport{box[0].AsDouble(), box[1].AsDouble(), box[2].AsDouble(), box[3].AsDouble()};
+                if (viewport->min_x < viewport->max_x && viewport->min_y < viewport->max_y)
+                {
+                    json::PrintSettings compact;
+                    compact.pretty = false;
+                    json::OutputSink sink(key);
+                    json::Writer(sink, compact).Value(bbox->second);
+                }
+                else
+                {
+                    viewport.reset();
+                }
+            }
+        }
+        else if (const auto *z = number("z"), *x = number("x"), *y = number("y"); z && x && y && z->IsInt() && x->IsInt() && y->IsInt())
+        {
+            const int zoom = z->AsInt();
+            const int64_t tiles = zoom >= 0 && zoom <= MAX_TILE_ZOOM ? int64_t{1} << zoom : 0;
+            if (tiles > 0 && x->AsInt() >= 0 && x->AsInt() < tiles && y->AsInt() >= 0 && y->AsInt() < tiles)
+            {
+                key = std::to_string(zoom) + '/' + std::to_string(x->AsInt()) + '/' + std::to_string(y->AsInt());
+                viewport = state->renderer ? state->renderer->TileViewport(zoom, x->AsInt(), y->AsInt()) : svgreader::Viewport{};
+            }
+        }
+        if (!viewport)
+        {
+            writer.Key("error_message").Value("invalid tile");
+            return;
+        }
+
+        std::shared_ptr<const std::string> tile;
+        {
+            std::lock_guard lock(state->tiles_mutex);
+            if (const auto it = state->tiles.find(key); it != state->tiles.end())
+            {
+                tile = it->second;
+            }
+        }
+        if (!tile)
+        {
+            tile = std::make_shared<const std::string>(RenderEscaped([&state, &viewport](std::ostream &out)
+                                                                     {
+                if (state->renderer)
+                {
+                    state->renderer->RenderTile(out, *viewport);
+                }
+                else
+                {
+                    svg::Document().Render(out);
+                } }));
+
+            std::lock_guard lock(state->tiles_mutex);
+            if (state->tiles.emplace(key, tile).second)
+            {
+                state->tiles_order.push_back(std::move(key));
+                if (state->tiles_order.size() > MAX_CACHED_TILES)
+                {
+                    state->tiles.erase(state->tiles_order.front());
+                    state->tiles_order.pop_front();
+                }
+            }
+        }
+        writer.Key("map").RawValue({*tile});
     }
 
-    inline void JsonReader::RenderMap(json::Builder &buff_node)
+    std::shared_ptr<JsonReader::MapState> JsonReader::GetMapState()
     {
-        const auto &mapdoc = RenderSVGRequest();
-        std::ostringstream sstream;
-        mapdoc.Render(sstream);
-        buff_node.Key("map").Value(sstream.str());
+        std::lock_guard lock(map_mutex_);
+        const uint64_t version = transport_catalog_.GetVersion();
+        const size_t settings_hash = RenderSettingsHash();
+        if (map_state_ && map_state_->catalog_version == version && map_state_->settings_hash == settings_hash)
+        {
+            return map_state_;
+        }
+
+        auto state = std::make_shared<MapState>();
+        state->catalog_version = version;
+        state->settings_hash = settings_hash;
+        if (auto settings = RenderSVGRequest())
+        {
+            state->buses = transport_catalog_.GetBusesVector();
+            if (map_state_ && map_state_->projection && map_state_->projection->Matches(version, *settings))
+            {
+                state->projection = map_state_->projection;
+            }
+            else
+            {
+                state->projection = std::make_shared<const svgreader::StopProjection>(state->buses, version, *settings);
+            }
+            state->renderer = std::make_unique<svgreader::MapRenderer>(*settings, state->buses, state->projection);
+        }
+        map_state_ = std::move(state);
+        return map_state_;
     }
-    inline void JsonReader::RenderStop(json::Builder &buff_node, const json::Node &value)
+
+    size_t JsonReader::RenderSettingsHash()
     {
-        const auto &stopinfo = transport_catalog_.GetStopInfo(value.AsDict().at("name").AsString());
+        // Разделы документа после загрузки не меняются, поэтому хэш считается один раз
+        if (!render_settings_hash_)
+        {
+            std::string settings;
+            if (document_json_.Has("render_settings"))
+            {
+                json::PrintSettings compact;
+                compact.pretty = false;
+                json::OutputSink sink(settings);
+                json::Writer(sink, compact).Value(document_json_.At("render_settings"));
+            }
+            render_settings_hash_ = std::hash<std::string>{}(settings);
+        }
+        return *render_settings_hash_;
+    }
+    inline void JsonReader::RenderStop(json::Writer &writer, const request_handler::StatRequest &request)
+    {
+        const auto &stopinfo = transport_catalog_.GetStopInfo(request.name);
         if (stopinfo.isFound)
         {
-            json::Array tmp;
+            writer.Key("buses").StartArray();
             for (const std::string_view str : stopinfo.buses)
             {
-                tmp.push_back(json::Node{std::string(str)});
+                writer.Value(str);
             }
-            buff_node.Key("buses").Value(tmp);
+            writer.EndArray();
         }
         else
         {
-            buff_node.Key("error_message").Value("not found");
+            writer.Key("error_message").Value("not found");
         }
     }
 
-    inline void JsonReader::RenderBus(json::Builder &buff_node, const json::Node &value)
+    inline void JsonReader::RenderBus(json::Writer &writer, const request_handler::StatRequest &request)
     {
-        // std::cout << value.AsMap().at("name").AsString() << std::endl;
-        const auto &businfo = transport_catalog_.GetBusInfo(value.AsDict().at("name").AsString());
+        const auto &businfo = transport_catalog_.GetBusInfo(request.name);
         if (businfo.isFound)
         {
 
-            buff_node.Key("curvature").Value(businfo.curvature);
-            buff_node.Key("route_length").Value( businfo.routeLength);
-            buff_node.Key("stop_count").Value(static_cast<int>(businfo.coutStopOnRoute));
-            buff_node.Key("unique_stop_count").Value(static_cast<int>(businfo.uniqStops));
+            writer.Key("curvature").Value(businfo.curvature);
+            writer.Key("route_length").Value(businfo.routeLength);
+            writer.Key("stop_count").Value(static_cast<int>(businfo.coutStopOnRoute));
+            writer.Key("unique_stop_count").Value(static_cast<int>(businfo.uniqStops));
         }
         else
         {
-           buff_node.Key("error_message").Value("not found");
+            writer.Key("error_message").Value("not found");
         }
     }
 
-    inline void JsonReader::StatRequest()
+    inline void JsonReader::AnswerStatRequest(json::Writer &writer, const json::Node &value)
     {
-        try
+        request_handler_.Answer(request_handler_.Decode(value), writer);
+    }
+
+    /*
+     * Вычисляет ответы на stat-запросы пакетами в пуле потоков.
+     * Каждый пакет выводится в собственный буфер, а буферы передаются
+     * в sink строго в порядке запросов, поэтому вывод совпадает с последовательным
+     */
+    class JsonReader::StatBatch
+    {
+    public:
+        StatBatch(JsonReader &reader, json::OutputSink &sink)
+            : reader_(reader), sink_(sink), max_pending_(reader.Pool().Size() * 2),
+              cache_(std::make_shared<request_handler::AnswerCache>(reader.request_handler_, reader.print_settings_))
+        {
+            json::Writer(sink_, reader_.print_settings_).StartArray().SuspendArray();
+        }
+
+        StatBatch(const StatBatch &) = delete;
+        StatBatch &operator=(const StatBatch &) = delete;
+
+        // При ошибке дожидаемся задач, которые ещё могут обращаться к reader_,
+        // и закрываем массив после уже выведенных ответов
+        ~StatBatch()
         {
-            const auto &root_map = document_json_.GetRoot().AsDict();
-            if (root_map.count("stat_requests") > 0)
+            for (auto &answers : pending_)
             {
-                json::Builder BuildDoc = json::Builder();
-                BuildDoc.StartArray();
-                for (const auto &value : root_map.at("stat_requests").AsArray())
+                if (answers.valid())
                 {
-                    BuildDoc.StartDict().Key("request_id").Value(value.AsDict().at("id").AsInt());
-    
-                    if (value.AsDict().at("type").AsString() == "Stop")
-                    {
-                        RenderStop(BuildDoc, value);
-                    }
+                    answers.wait();
+                }
+            }
+            if (!finished_)
+            {
+                json::Writer(sink_, reader_.print_settings_).ResumeArray(!written_).EndArray();
+            }
+        }
 
-                    if (value.AsDict().at("type").AsString() == "Bus")
-                    {
-                       RenderBus(BuildDoc, value);
-                    }
+        // Запрос из потока ввода: узел переходит в текущий пакет.
+        // Тяжёлый запрос отправляется отдельной задачей в полосу Throughput
+        void Add(json::Node request)
+        {
+            if (IsHeavy(request))
+            {
+                SubmitChunk();
+                std::vector<json::Node> heavy;
+                heavy.push_back(std::move(request));
+                Submit(std::move(heavy), nullptr, nullptr, Lane::Throughput);
+                return;
+            }
+            chunk_.push_back(std::move(request));
+            if (chunk_.size() >= STREAM_CHUNK_SIZE)
+            {
+                SubmitChunk();
+            }
+        }
 
-                    if (value.AsDict().at("type").AsString() == "Map")
+        // Запросы из загруженного документа делятся на пакеты без копирования,
+        // тяжёлые запросы выделяются в отдельные задачи
+        void AddRange(const json::Array &requests)
+        {
+            const size_t chunk_size = std::clamp<size_t>(requests.size() / (max_pending_ * 4), 16, 1024);
+            const json::Node *data = requests.data();
+            size_t begin = 0;
+            for (size_t i = 0; i <= requests.size(); ++i)
+            {
+                const bool heavy = i < requests.size() && IsHeavy(requests[i]);
+                if (i == requests.size() || heavy || i - begin == chunk_size)
+                {
+                    if (i > begin)
                     {
-                       RenderMap(BuildDoc);
+                        Submit({}, data + begin, data + i, Lane::Latency);
                     }
-                    BuildDoc.EndDict();
+                    begin = i;
+                }
+                if (heavy)
+                {
+                    Submit({}, data + i, data + i + 1, Lane::Throughput);
+                    begin = i + 1;
                 }
-                BuildDoc.EndArray();
-                json::Print(json::Document{BuildDoc.Build()},std::cout);
             }
         }
-        catch (const std::exception &e)
+
+        // Дожидается готовых ответов и сбрасывает их в поток
+        void Flush()
         {
-            std::cerr << e.what() << '\n';
+            SubmitChunk();
+            while (!pending_.empty())
+            {
+                WriteFront();
+            }
+            sink_.Flush();
         }
-    }
 
-    inline void JsonReader::ParsingRequestBus()
-    {
-        const auto &root_map = document_json_.GetRoot().AsDict();
-        if (root_map.count("base_requests") > 0)
+        void Finish()
         {
-            for (const auto &value : root_map.at("base_requests").AsArray())
-            {
-                if (value.AsDict().at("type").AsString() == "Bus")
-                {
-                    domain::Bus buff_bus;
+            Flush();
+            finished_ = true;
+            json::Writer(sink_, reader_.print_settings_).ResumeArray(!written_).EndArray();
+        }
 
-                    buff_bus.name = value.AsDict().at("name").AsString();
-                    buff_bus.type = value.AsDict().at("is_roundtrip").AsBool() ? domain::BusType::Ring : domain::BusType::Line;
+    private:
+        static constexpr size_t STREAM_CHUNK_SIZE = 64;
 
-                    for (const auto &v : value.AsDict().at("stops").AsArray())
+        bool IsHeavy(const json::Node &request) const
+        {
+            return reader_.request_handler_.Classify(request) == request_handler::CostClass::Render;
+        }
+
+        void SubmitChunk()
+        {
+            if (!chunk_.empty())
+            {
+                Submit(std::move(chunk_), nullptr, nullptr, Lane::Latency);
+                chunk_.clear();
+            }
+        }
+
+        // Ответы выводятся в порядке постановки задач, независимо от полосы
+        void Submit(std::vector<json::Node> owned, const json::Node *begin, const json::Node *end, Lane lane)
+        {
+            const bool is_first = submitted_ == 0;
+            submitted_ += owned.empty() ? end - begin : owned.size();
+            pending_.push_back(reader_.Pool().Submit(
+                [&reader = reader_, cache = cache_, owned = std::move(owned), begin, end, is_first]
+                {
+                    std::string answers;
                     {
-                        auto stop = transport_catalog_.FindStop(v.AsString());
-                        if (*stop != Stop{})
+                        json::OutputSink chunk_sink(answers);
+                        json::Writer writer(chunk_sink, reader.print_settings_);
+                        writer.ResumeArray(is_first);
+                        for (const json::Node &request : owned)
+                        {
+                            cache->Answer(reader.request_handler_.Decode(request), writer);
+                        }
+                        for (auto it = begin; it != end; ++it)
                         {
-                            buff_bus.stops.push_back(stop);
+                            cache->Answer(reader.request_handler_.Decode(*it), writer);
                         }
-                        // std::cout << "--" << v.AsString() << std::endl;
+                        writer.SuspendArray();
                     }
+                    return answers;
+                },
+                lane));
+            // Ограничиваем число готовых, но ещё не выведенных буферов
+            while (pending_.size() > max_pending_)
+            {
+                WriteFront();
+            }
+        }
 
-                    if (buff_bus.stops.front() != buff_bus.stops.back())
-                    {
+        // Задача снимается с очереди до get(): если она завершилась исключением,
+        // в очереди не остаётся future без состояния
+        void WriteFront()
+        {
+            std::future<std::string> answers = std::move(pending_.front());
+            pending_.pop_front();
+            sink_.Write(answers.get());
+            written_ = true;
+        }
 
-                        buff_bus.view = buff_bus.type;
-                    }
-                    else
-                    {
-                        buff_bus.view = domain::BusType::Ring;
-                    }
+        JsonReader &reader_;
+        json::OutputSink &sink_;
+        const size_t max_pending_;
+        std::vector<json::Node> chunk_;
+        std::deque<std::future<std::string>> pending_;
+        size_t submitted_ = 0;
+        // В массив выведен хотя бы один ответ
+        bool written_ = false;
+        bool finished_ = false;
+        // Одинаковые запросы пакета вычисляются один раз
+        std::shared_ptr<request_handler::AnswerCache> cache_;
+    };
 
-                    if (buff_bus.type == transport_catalog::domain::BusType::Line)
-                    {
-                        std::vector<const transport_catalog::domain::Stop *> reverse_name;
-                        std::for_each(std::next(buff_bus.stops.rbegin()), buff_bus.stops.rend(),
-                                      [&reverse_name](const transport_catalog::domain::Stop *name)
-                                      { reverse_name.push_back(name); });
-                        buff_bus.stops.insert(buff_bus.stops.end(), reverse_name.begin(), reverse_name.end());
-                    }
+    void JsonReader::PrintMetrics(std::ostream &output) const
+    {
+        if (!pool_)
+        {
+            return;
+        }
+        const std::pair<std::string_view, Lane> lanes[] = {{"latency", Lane::Latency}, {"throughput", Lane::Throughput}};
+        for (const auto &[name, lane] : lanes)
+        {
+            const auto stats = pool_->Stats(lane);
+            const auto average = stats.completed == 0 ? 0 : stats.total_latency.count() / stats.completed;
+            output << name << " lane: queued " << stats.queued << ", running " << stats.running
+                   << ", completed " << stats.completed << ", latency avg " << average
+                   << " us, max " << stats.max_latency.count() << " us" << std::endl;
+        }
+    }
 
-                    transport_catalog_.AddBus(buff_bus);
-                }
+    ThreadPool &JsonReader::Pool()
+    {
+        std::call_once(pool_once_, [this]
+                       { pool_ = std::make_unique<ThreadPool>(); });
+        return *pool_;
+    }
+
+    // Ответы выводятся по мере обработки запросов, дерево ответа целиком не строится
+    inline void JsonReader::StatRequest()
+    {
+        json::OutputSink sink(std::cout);
+        try
+        {
+            if (document_json_.Has("stat_requests"))
+            {
+                StatBatch batch(*this, sink);
+                batch.AddRange(document_json_.At("stat_requests").AsArray());
+                batch.Finish();
+            }
+        }
+        catch (const std::exception &e)
+        {
+            sink.Flush();
+            std::cerr << e.what() << '\n';
+        }
+    }
+
+    inline void JsonReader::StreamStatRequest(json::SectionReader &reader, std::istream &input)
+    {
+        json::OutputSink sink(std::cout);
+        try
+        {
+            StatBatch batch(*this, sink);
+            // После ошибки остаток массива только дочитывается, чтобы за ним
+            // можно было разобрать следующие разделы документа
+            std::exception_ptr error;
+            reader.ReadArray([&batch, &input, &error](json::Node &&value)
+                             {
+                                 if (error)
+                                 {
+                                     return;
+                                 }
+                                 try
+                                 {
+                                     batch.Add(std::move(value));
+                                     // Следующий запрос ещё не пришёл: отдаём клиенту готовые ответы
+                                     if (input.rdbuf()->in_avail() <= 0)
+                                     {
+                                         batch.Flush();
+                                     }
+                                 }
+                                 catch (...)
+                                 {
+                                     error = std::current_exception();
+                                 } });
+            if (error)
+            {
+                std::rethrow_exception(error);
             }
+            batch.Finish();
+        }
+        catch (const std::exception &e)
+        {
+            sink.Flush();
+            std::cerr << e.what() << '\n';
         }
     }
 
-    inline void JsonReader::ParsingRequestStop()
+    void JsonReader::ServeLines(std::istream &input, std::ostream &output)
     {
-        const auto &root_map = document_json_.GetRoot().AsDict();
-        if (root_map.count("base_requests") > 0)
+        json::OutputSink sink(output);
+        for (std::string line; std::getline(input, line);)
         {
+            if (line.find_first_not_of(" \t\r") == std::string::npos)
+            {
+                continue;
+            }
+            sink.Write(AnswerLine(line));
+            sink.Put('\n');
+            sink.Flush();
+        }
+    }
 
-            std::unordered_map<std::string_view, const json::Dict *> buff_stops_dist;
-            for (const auto &value : root_map.at("base_requests").AsArray())
+    std::string JsonReader::AnswerLine(std::string_view line)
+    {
+        json::PrintSettings line_settings = print_settings_;
+        line_settings.pretty = false;
+        // Ответ собирается отдельно, чтобы при ошибке не вывести его часть
+        std::ostringstream answer;
+        try
+        {
+            json::OutputSink answer_sink(answer);
+            json::Writer writer(answer_sink, line_settings);
+            AnswerStatRequest(writer, json::Load(line).GetRoot());
+        }
+        catch (const std::exception &e)
+        {
+            answer.str({});
+            json::OutputSink answer_sink(answer);
+            json::Writer(answer_sink, line_settings).StartDict().Key("error_message").Value(e.what()).EndDict();
+        }
+        return answer.str();
+    }
+
+    inline void JsonReader::ParsingRequestBus(const std::vector<BusRequest> &requests)
+    {
+        // Остановки маршрутов разрешаются параллельно, каждый маршрут пишется в свою ячейку
+        std::vector<domain::Bus> buses(requests.size());
+        Pool().ParallelFor(requests.size(), 64, [&](size_t begin, size_t end)
+                           {
+            for (size_t i = begin; i < end; ++i)
             {
-                if (value.AsDict().at("type").AsString() == "Stop")
+                const auto &request = requests[i];
+                domain::Bus &buff_bus = buses[i];
+
+                buff_bus.name = request.name;
+                buff_bus.type = request.is_roundtrip ? domain::BusType::Ring : domain::BusType::Line;
+
+                buff_bus.stops.reserve(buff_bus.type == domain::BusType::Line ? request.stops->size() * 2 : request.stops->size());
+                for (const auto &v : *request.stops)
                 {
-                    domain::Stop buff_stop;
+                    auto stop = transport_catalog_.FindStop(v.AsString());
+                    if (*stop != Stop{})
+                    {
+                        buff_bus.stops.push_back(stop);
+                    }
+                }
 
-                    buff_stop.name = value.AsDict().at("name").AsString();
-                    buff_stop.coordinates.lat = value.AsDict().at("latitude").AsDouble();
-                    buff_stop.coordinates.lng = value.AsDict().at("longitude").AsDouble();
-                    transport_catalog_.AddStop(buff_stop);
-                    buff_stops_dist[value.AsDict().at("name").AsString()] = &value.AsDict().at("road_distances").AsDict();
+                if (buff_bus.stops.front() != buff_bus.stops.back())
+                {
+
+                    buff_bus.view = buff_bus.type;
                 }
-            }
+                else
+                {
+                    buff_bus.view = domain::BusType::Ring;
+                }
+
+                if (buff_bus.type == transport_catalog::domain::BusType::Line)
+                {
+                    // Обратный путь без конечной остановки
+                    const size_t forward = buff_bus.stops.size();
+                    for (size_t j = forward; j-- > 1;)
+                    {
+                        buff_bus.stops.push_back(buff_bus.stops[j - 1]);
+                    }
+                }
+            } });
+
+        transport_catalog_.AddBuses(buses, Pool());
+    }
 
-            for (const auto &[key, value] : buff_stops_dist)
+    inline void JsonReader::ParsingRequestStop(const std::vector<StopRequest> &requests)
+    {
+        std::vector<domain::Stop> stops(requests.size());
+        // Позиции расстояний каждой остановки в общем массиве — префиксные суммы их количества
+        std::vector<size_t> offsets(requests.size() + 1, 0);
+        for (size_t i = 0; i < requests.size(); ++i)
+        {
+            offsets[i + 1] = offsets[i] + requests[i].road_distances->size();
+        }
+        Pool().ParallelFor(requests.size(), 1024, [&](size_t begin, size_t end)
+                           {
+            for (size_t i = begin; i < end; ++i)
             {
-                for (const auto &[l, r] : *value)
+                stops[i].name = requests[i].name;
+                stops[i].coordinates = requests[i].coordinates;
+            } });
+        transport_catalog_.AddStops(stops);
+
+        // Расстояния добавляются после всех остановок, так как могут ссылаться на ещё не прочитанные
+        struct Distance
+        {
+            const Stop *from;
+            const Stop *to;
+            int meters;
+        };
+        std::vector<Distance> distances(offsets.back());
+        Pool().ParallelFor(requests.size(), 256, [&](size_t begin, size_t end)
+                           {
+            for (size_t i = begin; i < end; ++i)
+            {
+                const Stop *from = transport_catalog_.FindStop(requests[i].name);
+                size_t pos = offsets[i];
+                for (const auto &[to, meters] : *requests[i].road_distances)
                 {
-                    // std::cout << key << "--=-==-=" << l << "---" << r.AsInt() << std::endl;
-                    transport_catalog_.AddDistances(key, l, r.AsInt());
+                    distances[pos++] = {from, transport_catalog_.FindStop(to), meters.AsInt()};
                 }
-            }
+            } });
+
+        transport_catalog_.ReserveDistances(distances.size());
+        for (const auto &distance : distances)
+        {
+            transport_catalog_.AddDistances(distance.from, distance.to, distance.meters);
         }
     }
 
     inline void JsonReader::BaseRequest()
     {
-        ParsingRequestStop();
-        ParsingRequestBus();
+        if (!document_json_.Has("base_requests"))
+        {
+            return;
+        }
+        const auto &requests = document_json_.At("base_requests").AsArray();
+        std::vector<StopRequest> stops;
+        std::vector<BusRequest> buses;
+        for (const auto &value : requests)
+        {
+            const auto &request = value.AsDict();
+            const auto &type = request.at("type").AsString();
+            if (type == "Stop")
+            {
+                stops.push_back({request.at("name").AsString(),
+                                 {request.at("latitude").AsDouble(), request.at("longitude").AsDouble()},
+                                 &request.at("road_distances").AsDict()});
+            }
+            else if (type == "Bus")
+            {
+                buses.push_back({request.at("name").AsString(),
+                                 request.at("is_roundtrip").AsBool(),
+                                 &request.at("stops").AsArray()});
+            }
+        }
+        ParsingRequestStop(stops);
+        ParsingRequestBus(buses);
     }
 
-    svg::Document JsonReader::RenderSVGRequest()
+    std::optional<svgreader::RenderSettings> JsonReader::RenderSVGRequest()
     {
-        svg::Document doc;
+        svgreader::RenderSettings redsetting;
         try
         {
-            svgreader::RenderSettings redsetting;
-            const auto &root_map = document_json_.GetRoot().AsDict().at("render_settings").AsDict();
+            const auto &root_map = document_json_.At("render_settings").AsDict();
 
             redsetting.width = root_map.at("width").AsDouble();
             redsetting.height = root_map.at("height").AsDouble();
@@ -199,16 +789,22 @@ namespace transport_catalog::json_reader
             redsetting.underlayer_color = SetColor(root_map.at("underlayer_color"));
             redsetting.underlayer_width = root_map.at("underlayer_width").AsDouble();
             redsetting.color_palette = SetColorPalette(root_map.at("color_palette").AsArray());
-
-            auto buses = transport_catalog_.GetBusesVector();
-            svgreader::MapRenderer maprend(redsetting, buses);
-            doc = maprend.RenderMap();
+            if (const auto tolerance = root_map.find("simplify_tolerance"); tolerance != root_map.end())
+            {
+                redsetting.simplify_tolerance = tolerance->second.AsDouble();
+            }
+            if (const auto precision = root_map.find("coordinate_precision"); precision != root_map.end())
+            {
+                redsetting.coordinate_decimals = std::clamp(precision->second.AsInt(), 0, svg::MAX_DECIMALS);
+            }
         }
         catch (const std::exception &e)
         {
+            // Без настроек выводится пустая карта
             std::cerr << "Error -" << e.what() << '\n';
+            return std::nullopt;
         }
-        return doc;
+        return redsetting;
     }
 
     svg::Point JsonReader::Offset(const json::Array &offset)
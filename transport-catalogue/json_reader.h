@@ -1,10 +1,18 @@
 #pragma once
 #include "json.h"
 #include "json_builder.h"
+#include "json_writer.h"
 #include "transport_catalogue.h"
 #include "map_renderer.h"
+#include "request_handler.h"
+#include "thread_pool.h"
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
 
 namespace transport_catalog::json_reader
 {
@@ -13,22 +21,87 @@ namespace transport_catalog::json_reader
     {
     private:
         /* data */
-        json::Document document_json_;
+        // Разделы запроса разбираются только при обращении к ним
+        json::LazyDocument document_json_;
         transport_catalog::TransportCatalogue transport_catalog_;
+        request_handler::RequestHandler request_handler_{transport_catalog_};
+        // Точность вывода curvature и route_length задаётся здесь явно
+        json::PrintSettings print_settings_;
+        // Пул для параллельной обработки stat_requests, создаётся при первой необходимости.
+        // Запросы сервера обращаются к нему из разных потоков
+        std::once_flag pool_once_;
+        std::unique_ptr<ThreadPool> pool_;
+        // Состояние отрисовки карты. Действительно, пока не изменились
+        // каталог и настройки отрисовки
+        struct MapState
+        {
+            uint64_t catalog_version = 0;
+            size_t settings_hash = 0;
+            std::vector<const domain::Bus *> buses;
+            // Координаты остановок на карте. Переходит в новое состояние,
+            // если не изменились каталог и размеры карты
+            std::shared_ptr<const svgreader::StopProjection> projection;
+            // Пуст, если настройки отрисовки некорректны
+            std::unique_ptr<svgreader::MapRenderer> renderer;
+            // Полная карта в виде JSON-строки, строится при первом запросе
+            std::once_flag map_once;
+            std::string map_json;
+            // Плитки в виде JSON-строк по ключу области, старые вытесняются
+            std::mutex tiles_mutex;
+            std::unordered_map<std::string, std::shared_ptr<const std::string>> tiles;
+            std::deque<std::string> tiles_order;
+        };
+        static constexpr size_t MAX_CACHED_TILES = 4096;
+        static constexpr int MAX_TILE_ZOOM = 30;
+        std::mutex map_mutex_;
+        std::shared_ptr<MapState> map_state_;
+        std::optional<size_t> render_settings_hash_;
+        std::shared_ptr<MapState> GetMapState();
+        size_t RenderSettingsHash();
+        class StatBatch;
+        ThreadPool &Pool();
         inline void StatRequest();
+        inline void StreamStatRequest(json::SectionReader &reader, std::istream &input);
+        inline void AnswerStatRequest(json::Writer &writer, const json::Node &value);
         inline void BaseRequest();
-        svg::Document RenderSVGRequest();
+        // Пустой результат, если настройки отрисовки отсутствуют или некорректны
+        std::optional<svgreader::RenderSettings> RenderSVGRequest();
         svg::Color SetColor(const json::Node &color);
         std::vector<svg::Color> SetColorPalette(const json::Array &palette);
         svg::Point Offset(const json::Array &offset);
-        inline void RenderMap(json::Builder &buff_node);
-        inline void RenderStop(json::Builder &buff_node, const json::Node &value);
-        inline void RenderBus(json::Builder &buff_node, const json::Node &value);
-        inline void ParsingRequestBus();
-        inline void ParsingRequestStop();
+        inline void RenderMap(json::Writer &writer, const request_handler::StatRequest &request);
+        inline void RenderMapSubset(json::Writer &writer, const request_handler::StatRequest &request);
+        inline void RenderMapTile(json::Writer &writer, const request_handler::StatRequest &request);
+        inline void RenderStop(json::Writer &writer, const request_handler::StatRequest &request);
+        inline void RenderBus(json::Writer &writer, const request_handler::StatRequest &request);
+        void RegisterHandlers();
+        // Запросы base_requests, разложенные по видам за один проход
+        struct StopRequest
+        {
+            std::string_view name;
+            geo::Coordinates coordinates;
+            const json::Dict *road_distances;
+        };
+        struct BusRequest
+        {
+            std::string_view name;
+            bool is_roundtrip;
+            const json::Array *stops;
+        };
+        inline void ParsingRequestBus(const std::vector<BusRequest> &requests);
+        inline void ParsingRequestStop(const std::vector<StopRequest> &requests);
 
     public:
-        JsonReader(std::istream &it);
+        // Загружает базу и отвечает на stat_requests одного JSON-документа
+        JsonReader(std::istream &it, const json::PrintSettings &print_settings = {});
+        // Построчный режим (NDJSON): каждая строка input — один stat-запрос,
+        // ответ на него выводится одной строкой и сразу сбрасывается в output
+        void ServeLines(std::istream &input, std::ostream &output);
+        // Отвечает на один stat-запрос, записанный в line, и возвращает ответ одной строкой.
+        // Может вызываться из нескольких потоков одновременно
+        std::string AnswerLine(std::string_view line);
+        // Глубина очередей и задержки полос пула обработки запросов
+        void PrintMetrics(std::ostream &output) const;
         ~JsonReader();
     };
 
@@ -0,0 +1,241 @@
+#include "json_writer.h"
+
+namespace json
+{
+    using namespace std::literals;
+
+    Writer::Writer(OutputSink &sink, const PrintSettings &settings, int base_depth)
+        : sink_(sink), settings_(settings), base_depth_(base_depth)
+    {
+    }
+
+    bool Writer::IsComplete() const
+    {
+        return complete_;
+    }
+
+    void Writer::PrintIndent(int depth)
+    {
+        for (int i = depth * settings_.indent_step; i > 0; --i)
+        {
+            sink_.Put(' ');
+        }
+    }
+
+    void Writer::NextItem(Frame &frame)
+    {
+        if (settings_.pretty)
+        {
+            sink_.Write(frame.is_empty ? "\n"sv : ",\n"sv);
+            PrintIndent(base_depth_ + static_cast<int>(frames_.size()));
+        }
+        else if (!frame.is_empty)
+        {
+            sink_.Put(',');
+        }
+        frame.is_empty = false;
+    }
+
+    // Проверяет, что значение допустимо в текущей позиции, и выводит разделитель
+    void Writer::BeforeValue()
+    {
+        if (complete_)
+        {
+            throw std::logic_error("JSON is already complete");
+        }
+        if (frames_.empty())
+        {
+            return;
+        }
+        Frame &frame = frames_.back();
+        if (frame.is_dict)
+        {
+            if (!frame.has_key)
+            {
+                throw std::logic_error("Value in a map must follow a key");
+            }
+            frame.has_key = false;
+        }
+        else
+        {
+            NextItem(frame);
+        }
+    }
+
+    Writer &Writer::Key(std::string_view key)
+    {
+        if (complete_ || frames_.empty() || !frames_.back().is_dict || frames_.back().has_key)
+        {
+            throw std::logic_error("Key must be within a map and go first");
+        }
+        Frame &frame = frames_.back();
+        NextItem(frame);
+        frame.has_key = true;
+        PrintString(key, sink_);
+        sink_.Write(settings_.pretty ? ": "sv : ":"sv);
+        return *this;
+    }
+
+    Writer &Writer::StartDict()
+    {
+        BeforeValue();
+        sink_.Put('{');
+        frames_.push_back(Frame{true});
+        return *this;
+    }
+
+    Writer &Writer::StartArray()
+    {
+        BeforeValue();
+        sink_.Put('[');
+        frames_.push_back(Frame{false});
+        return *this;
+    }
+
+    void Writer::End(bool is_dict)
+    {
+        if (complete_ || frames_.empty() || frames_.back().is_dict != is_dict || frames_.back().has_key)
+        {
+            throw std::logic_error(is_dict ? "Bad map end" : "Bad array end");
+        }
+        const bool is_empty = frames_.back().is_empty;
+        frames_.pop_back();
+        if (settings_.pretty)
+        {
+            // Пустой контейнер json::Print выводит как "[\n\n]", сохраняем этот формат
+            sink_.Write(is_empty ? "\n\n"sv : "\n"sv);
+            PrintIndent(base_depth_ + static_cast<int>(frames_.size()));
+        }
+        sink_.Put(is_dict ? '}' : ']');
+        complete_ = frames_.empty();
+    }
+
+    Writer &Writer::EndDict()
+    {
+        End(true);
+        return *this;
+    }
+
+    Writer &Writer::EndArray()
+    {
+        End(false);
+        return *this;
+    }
+
+    Writer &Writer::ResumeArray(bool is_empty)
+    {
+        if (complete_ || !frames_.empty())
+        {
+            throw std::logic_error("Only a root array can be resumed");
+        }
+        frames_.push_back(Frame{false, is_empty});
+        return *this;
+    }
+
+    Writer &Writer::SuspendArray()
+    {
+        if (complete_ || frames_.empty() || frames_.back().is_dict)
+        {
+            throw std::logic_error("Bad array suspend");
+        }
+        frames_.pop_back();
+        return *this;
+    }
+
+    Writer &Writer::Value(std::nullptr_t)
+    {
+        BeforeValue();
+        sink_.Write("null"sv);
+        complete_ = frames_.empty();
+        return *this;
+    }
+
+    Writer &Writer::Value(bool value)
+    {
+        BeforeValue();
+        sink_.Write(value ? "true"sv : "false"sv);
+        complete_ = frames_.empty();
+        return *this;
+    }
+
+    Writer &Writer::Value(int value)
+    {
+        BeforeValue();
+        char buffer[MAX_NUMBER_LENGTH];
+        sink_.Write({buffer, static_cast<size_t>(FormatNumber(buffer, value) - buffer)});
+        complete_ = frames_.empty();
+        return *this;
+    }
+
+    Writer &Writer::Value(double value)
+    {
+        BeforeValue();
+        char buffer[MAX_NUMBER_LENGTH];
+        sink_.Write({buffer, static_cast<size_t>(FormatNumber(buffer, value, settings_.double_precision) - buffer)});
+        complete_ = frames_.empty();
+        return *this;
+    }
+
+    Writer &Writer::Value(std::string_view value)
+    {
+        BeforeValue();
+        PrintString(value, sink_);
+        complete_ = frames_.empty();
+        return *this;
+    }
+
+    Writer &Writer::Value(const std::string &value)
+    {
+        return Value(std::string_view(value));
+    }
+
+    Writer &Writer::Value(const char *value)
+    {
+        return Value(std::string_view(value));
+    }
+
+    Writer &Writer::RawValue(std::initializer_list<std::string_view> parts)
+    {
+        BeforeValue();
+        for (const std::string_view part : parts)
+        {
+            sink_.Write(part);
+        }
+        complete_ = frames_.empty();
+        return *this;
+    }
+
+    Writer &Writer::Value(const Node &value)
+    {
+        switch (value.GetType())
+        {
+        case Node::Type::NULL_VALUE:
+            return Value(nullptr);
+        case Node::Type::BOOL:
+            return Value(value.AsBool());
+        case Node::Type::INT:
+            return Value(value.AsInt());
+        case Node::Type::DOUBLE:
+            return Value(value.AsDouble());
+        case Node::Type::STRING:
+            return Value(std::string_view(value.AsString()));
+        case Node::Type::ARRAY:
+            StartArray();
+            for (const Node &item : value.AsArray())
+            {
+                Value(item);
+            }
+            return EndArray();
+        case Node::Type::DICT:
+            StartDict();
+            for (const auto &[key, item] : value.AsDict())
+            {
+                Key(key);
+                Value(item);
+            }
+            return EndDict();
+        }
+        return *this;
+    }
+
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "json.h"
+
+#include <initializer_list>
+#include <string_view>
+#include <vector>
+
+namespace json
+{
+
+    /*
+     * Потоковый писатель JSON. Повторяет интерфейс Builder, но не строит
+     * дерево Node: каждый вызов сразу выводит данные в OutputSink.
+     * Формат вывода совпадает с json::Print.
+     */
+    class Writer
+    {
+    public:
+        // base_depth — уровень вложенности, на котором будет стоять выводимое значение
+        explicit Writer(OutputSink &sink, const PrintSettings &settings = {}, int base_depth = 0);
+
+        Writer &Key(std::string_view key);
+        Writer &Value(const Node &value);
+        Writer &Value(std::nullptr_t);
+        Writer &Value(bool value);
+        Writer &Value(int value);
+        Writer &Value(double value);
+        Writer &Value(std::string_view value);
+        Writer &Value(const std::string &value);
+        Writer &Value(const char *value);
+        // Выводит заранее сериализованное значение, склеенное из частей
+        Writer &RawValue(std::initializer_list<std::string_view> parts);
+        Writer &StartDict();
+        Writer &StartArray();
+        Writer &EndDict();
+        Writer &EndArray();
+
+        // Продолжает корневой массив, открытый другим писателем: следующие значения
+        // выводятся как его элементы. is_empty — в массиве ещё нет элементов
+        Writer &ResumeArray(bool is_empty);
+        // Отсоединяется от массива, не закрывая его
+        Writer &SuspendArray();
+
+        // Документ полностью выведен
+        bool IsComplete() const;
+
+    private:
+        struct Frame
+        {
+            bool is_dict = false;
+            bool is_empty = true;
+            bool has_key = false;
+        };
+
+        void BeforeValue();
+        void NextItem(Frame &frame);
+        void PrintIndent(int depth);
+        void End(bool is_dict);
+
+        OutputSink &sink_;
+        const PrintSettings settings_;
+        int base_depth_ = 0;
+        std::vector<Frame> frames_;
+        bool complete_ = false;
+    };
+
+}
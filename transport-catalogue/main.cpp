@@ -1,14 +1,179 @@
 #define _USE_MATH_DEFINES
+#include <atomic>
+#include <charconv>
+#include <csignal>
 #include <iostream>
 #include <iomanip>
+#include <optional>
+#include <string>
+#include <string_view>
 #include "json_reader.h"
+#include "server.h"
 
 using namespace std;
 using namespace transport_catalog;
-int main()
+
+namespace
+{
+    const char *const USAGE =
+        "Usage: transport_catalogue [--compact] [--metrics] [--ndjson]\n"
+        "                           [--serve unix:PATH|tcp:PORT] [--workers N] [--max-connections N] [--max-in-flight N]\n"
+        "       transport_catalogue --load-test unix:PATH|tcp:PORT --requests FILE [--connections N] [--count N]";
+
+    // Сервер, который завершают SIGINT и SIGTERM
+    std::atomic<server::Server *> running_server = nullptr;
+
+    void StopServer(int)
+    {
+        if (auto *server = running_server.load())
+        {
+            server->Stop();
+        }
+    }
+}
+
+int main(int argc, char *argv[])
 {
+    // Потоки читают и пишут через собственные буферы, без синхронизации с stdio
+    std::ios::sync_with_stdio(false);
+    std::cin.tie(nullptr);
+
+    json::PrintSettings print_settings;
+    bool serve_lines = false;
+    bool print_metrics = false;
+    std::optional<server::ServerSettings> server_settings;
+    std::optional<server::LoadTestSettings> load_test_settings;
+    size_t workers = ThreadPool::DefaultThreadCount();
+    size_t max_connections = server::ServerSettings{}.max_connections;
+    size_t max_in_flight = server::ServerSettings{}.max_in_flight;
+    size_t connections = server::LoadTestSettings{}.connections;
+    size_t requests = server::LoadTestSettings{}.requests;
+    std::string requests_path;
+    try
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string_view arg = argv[i];
+            const auto value = [&]() -> std::string_view
+            {
+                if (i + 1 >= argc)
+                {
+                    throw std::invalid_argument("Missing value for "s + std::string(arg));
+                }
+                return argv[++i];
+            };
+            // Только положительное число целиком: "-1" и "0" не принимаются
+            const auto number = [&]()
+            {
+                const std::string_view text = value();
+                size_t result = 0;
+                const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), result);
+                if (error != std::errc{} || end != text.data() + text.size() || result == 0)
+                {
+                    throw std::invalid_argument("Expected a positive number for "s + std::string(arg) + "\n"s + USAGE);
+                }
+                return result;
+            };
+
+            // --compact выводит ответ одной строкой без отступов
+            if (arg == "--compact"sv)
+            {
+                print_settings.pretty = false;
+            }
+            // --ndjson после документа с базой читает запросы построчно до конца ввода
+            else if (arg == "--ndjson"sv)
+            {
+                serve_lines = true;
+            }
+            // --serve unix:PATH | tcp:PORT — после загрузки базы обслуживает запросы через сокет
+            else if (arg == "--serve"sv)
+            {
+                server_settings.emplace();
+                server_settings->endpoint = server::ParseEndpoint(value());
+            }
+            // --load-test unix:PATH | tcp:PORT --requests FILE — нагрузочный клиент
+            else if (arg == "--load-test"sv)
+            {
+                load_test_settings.emplace();
+                load_test_settings->endpoint = server::ParseEndpoint(value());
+            }
+            // --metrics по завершении выводит в stderr состояние очередей пула
+            else if (arg == "--metrics"sv)
+            {
+                print_metrics = true;
+            }
+            else if (arg == "--workers"sv)
+            {
+                workers = number();
+            }
+            else if (arg == "--max-connections"sv)
+            {
+                max_connections = number();
+            }
+            else if (arg == "--max-in-flight"sv)
+            {
+                max_in_flight = number();
+            }
+            else if (arg == "--connections"sv)
+            {
+                connections = number();
+            }
+            else if (arg == "--count"sv)
+            {
+                requests = number();
+            }
+            else if (arg == "--requests"sv)
+            {
+                requests_path = std::string(value());
+            }
+            else
+            {
+                throw std::invalid_argument("Unknown option "s + std::string(arg) + "\n"s + USAGE);
+            }
+        }
+
+        if (load_test_settings)
+        {
+            load_test_settings->connections = connections;
+            load_test_settings->requests = requests;
+            load_test_settings->requests_path = requests_path;
+            const auto result = server::RunLoadTest(*load_test_settings);
+            std::cout << "requests: "sv << result.requests << ", errors: "sv << result.errors
+                      << ", time: "sv << result.seconds << " s, throughput: "sv << result.requests_per_second << " req/s\n"sv
+                      << "latency p50: "sv << result.p50_ms << " ms, p99: "sv << result.p99_ms
+                      << " ms, max: "sv << result.max_ms << " ms"sv << std::endl;
+            return 0;
+        }
 
-    json_reader::JsonReader x =(std::cin);
+        json_reader::JsonReader x(std::cin, print_settings);
+        if (server_settings)
+        {
+            server_settings->workers = workers;
+            server_settings->max_connections = max_connections;
+            server_settings->max_in_flight = max_in_flight;
+            std::cout.flush();
+            server::Server server(*server_settings, [&x](std::string_view line)
+                                  { return x.AnswerLine(line); });
+            running_server = &server;
+            std::signal(SIGINT, StopServer);
+            std::signal(SIGTERM, StopServer);
+            server.Run();
+            running_server = nullptr;
+        }
+        else if (serve_lines)
+        {
+            x.ServeLines(std::cin, std::cout);
+        }
+        if (print_metrics)
+        {
+            x.PrintMetrics(std::cerr);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
     // reader::input::InputReader ir;
     // reader::utils::LoadStreamFlowData(ir, std::cin);
 
@@ -1,4 +1,8 @@
 #include "map_renderer.h"
+#include <cmath>
+#include <iterator>
+#include <sstream>
+#include <unordered_set>
 #include <utility>
 
 namespace transport_catalog::svgreader
@@ -15,6 +19,67 @@ namespace transport_catalog::svgreader
             (coords.lng - min_lon_) * zoom_coeff_ + padding_,
             (max_lat_ - coords.lat) * zoom_coeff_ + padding_};
     }
+    namespace
+    {
+        // Квадрат расстояния от точки до отрезка [from, to]
+        double SquaredDistance(svg::Point point, svg::Point from, svg::Point to)
+        {
+            const double dx = to.x - from.x;
+            const double dy = to.y - from.y;
+            const double length = dx * dx + dy * dy;
+            double t = length > 0.0 ? ((point.x - from.x) * dx + (point.y - from.y) * dy) / length : 0.0;
+            t = std::clamp(t, 0.0, 1.0);
+            const double x = from.x + t * dx - point.x;
+            const double y = from.y + t * dy - point.y;
+            return x * x + y * y;
+        }
+    }
+
+    std::vector<svg::Point> SimplifyPolyline(const std::vector<svg::Point> &points, double tolerance)
+    {
+        if (tolerance <= 0.0 || points.size() < 3)
+        {
+            return points;
+        }
+        // Алгоритм Дугласа — Пекера без рекурсии
+        std::vector<bool> keep(points.size(), false);
+        keep.front() = keep.back() = true;
+        const double squared_tolerance = tolerance * tolerance;
+        std::vector<std::pair<size_t, size_t>> ranges{{0, points.size() - 1}};
+        while (!ranges.empty())
+        {
+            const auto [first, last] = ranges.back();
+            ranges.pop_back();
+            double max_distance = 0.0;
+            size_t farthest = first;
+            for (size_t i = first + 1; i < last; ++i)
+            {
+                const double distance = SquaredDistance(points[i], points[first], points[last]);
+                if (distance > max_distance)
+                {
+                    max_distance = distance;
+                    farthest = i;
+                }
+            }
+            if (max_distance > squared_tolerance)
+            {
+                keep[farthest] = true;
+                ranges.emplace_back(first, farthest);
+                ranges.emplace_back(farthest, last);
+            }
+        }
+
+        std::vector<svg::Point> result;
+        for (size_t i = 0; i < points.size(); ++i)
+        {
+            if (keep[i])
+            {
+                result.push_back(points[i]);
+            }
+        }
+        return result;
+    }
+
     // Render Graphics
     RouteLine::RouteLine(std::vector<svg::Point> &points, const RenderSettings &config, size_t &color) : points_(points), config_(config), color_index_(color)
     {
@@ -34,26 +99,26 @@ namespace transport_catalog::svgreader
 
     void RouteLine::Draw(svg::ObjectContainer &container) const
     {
-        auto polyline = std::make_unique<svg::Polyline>();
-        polyline->SetStrokeWidth(config_.line_width);
-        polyline->SetStrokeColor(*(config_.color_palette.begin() + color_index_));
-        polyline->SetFillColor(svg::NoneColor);
-        polyline->SetStrokeLineCap(svg::StrokeLineCap::ROUND);
-        polyline->SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
-        for (auto x : points_)
+        svg::Polyline polyline;
+        polyline.SetStrokeWidth(config_.line_width);
+        polyline.SetStrokeColor(*(config_.color_palette.begin() + color_index_));
+        polyline.SetFillColor(svg::NoneColor);
+        polyline.SetStrokeLineCap(svg::StrokeLineCap::ROUND);
+        polyline.SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
+        for (auto x : SimplifyPolyline(points_, config_.simplify_tolerance))
         {
-            polyline->AddPoint(x);
+            polyline.AddPoint(x);
         }
-        container.AddPtr(std::move(polyline));
+        container.Add(std::move(polyline));
     }
 
     void PointMap::Draw(svg::ObjectContainer &container) const
     {
-        auto circle = std::make_unique<svg::Circle>();
-        circle->SetCenter(point_);
-        circle->SetRadius(config_.stop_radius);
-        circle->SetFillColor("white");
-        container.AddPtr(std::move(circle));
+        svg::Circle circle;
+        circle.SetCenter(point_);
+        circle.SetRadius(config_.stop_radius);
+        circle.SetFillColor("white");
+        container.Add(std::move(circle));
     }
 
     void TextMapBus::Draw(svg::ObjectContainer &container) const
@@ -61,26 +126,26 @@ namespace transport_catalog::svgreader
 
         const auto make_text = [this]()
         {
-            auto text = std::make_unique<svg::Text>();
-            text->SetPosition(point_);
-            text->SetOffset(config_.bus_label_offset);
-            text->SetFontSize(config_.bus_label_font_size);
-            text->SetFontFamily("Verdana");
-            text->SetFontWeight("bold");
-            text->SetData(std::string(text_));
+            svg::Text text;
+            text.SetPosition(point_);
+            text.SetOffset(config_.bus_label_offset);
+            text.SetFontSize(config_.bus_label_font_size);
+            text.SetFontFamily("Verdana");
+            text.SetFontWeight("bold");
+            text.SetData(std::string(text_));
             return text;
         };
         auto layer = make_text();
-        layer->SetFillColor(config_.underlayer_color);
-        layer->SetStrokeColor(config_.underlayer_color);
-        layer->SetStrokeWidth(config_.underlayer_width);
-        layer->SetStrokeLineCap(svg::StrokeLineCap::ROUND);
-        layer->SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
-        container.AddPtr(std::move(layer));
+        layer.SetFillColor(config_.underlayer_color);
+        layer.SetStrokeColor(config_.underlayer_color);
+        layer.SetStrokeWidth(config_.underlayer_width);
+        layer.SetStrokeLineCap(svg::StrokeLineCap::ROUND);
+        layer.SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
+        container.Add(std::move(layer));
 
         auto text = make_text();
-        text->SetFillColor(*(config_.color_palette.begin() + color_index_));
-        container.AddPtr(std::move(text));
+        text.SetFillColor(*(config_.color_palette.begin() + color_index_));
+        container.Add(std::move(text));
     }
 
     void TextMapStop::Draw(svg::ObjectContainer &container) const
@@ -88,50 +153,72 @@ namespace transport_catalog::svgreader
 
         const auto make_text = [this]()
         {
-            auto text = std::make_unique<svg::Text>();
-            text->SetPosition(point_);
-            text->SetOffset(config_.stop_label_offset);
-            text->SetFontSize(config_.stop_label_font_size);
-            text->SetFontFamily("Verdana");
-            text->SetData(std::string(text_));
+            svg::Text text;
+            text.SetPosition(point_);
+            text.SetOffset(config_.stop_label_offset);
+            text.SetFontSize(config_.stop_label_font_size);
+            text.SetFontFamily("Verdana");
+            text.SetData(std::string(text_));
             return text;
         };
 
         auto layer = make_text();
-        layer->SetFillColor(config_.underlayer_color);
-        layer->SetStrokeColor(config_.underlayer_color);
-        layer->SetStrokeWidth(config_.underlayer_width);
-        layer->SetStrokeLineCap(svg::StrokeLineCap::ROUND);
-        layer->SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
-        container.AddPtr(std::move(layer));
+        layer.SetFillColor(config_.underlayer_color);
+        layer.SetStrokeColor(config_.underlayer_color);
+        layer.SetStrokeWidth(config_.underlayer_width);
+        layer.SetStrokeLineCap(svg::StrokeLineCap::ROUND);
+        layer.SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
+        container.Add(std::move(layer));
 
         auto text = make_text();
-        text->SetFillColor("black");
-        container.AddPtr(std::move(text));
+        text.SetFillColor("black");
+        container.Add(std::move(text));
     }
 
-    MapRenderer::StopSet MapRenderer::ConvertBuses(std::vector<const domain::Bus *> &dictBus)
+    StopProjection::StopProjection(const std::vector<const domain::Bus *> &buses, uint64_t catalog_version, const RenderSettings &config)
+        : catalog_version_(catalog_version), width_(config.width), height_(config.height), padding_(config.padding)
     {
-        StopSet stops;
-        for (const auto bus_link : dictBus)
+        std::vector<const domain::Stop *> all_stops;
+        size_t max_id = 0;
+        for (const auto bus_link : buses)
         {
             for (const auto stop : bus_link->stops)
             {
-                stops.insert(stop);
+                all_stops.push_back(stop);
+                max_id = std::max(max_id, stop->id);
             }
         }
-        return stops;
-    }
+        // Из остановок с одинаковым названием остаётся встреченная первой
+        stops_ = all_stops;
+        std::stable_sort(stops_.begin(), stops_.end(), [](const domain::Stop *lhs, const domain::Stop *rhs)
+                         { return lhs->name < rhs->name; });
+        stops_.erase(std::unique(stops_.begin(), stops_.end(), [](const domain::Stop *lhs, const domain::Stop *rhs)
+                                 { return lhs->name == rhs->name; }),
+                     stops_.end());
 
-    SphereProjector MapRenderer::GetSphere(const MapRenderer::StopSet &stops, const RenderSettings &config) const
-    {
         std::vector<geo::Coordinates> coordinates;
-        coordinates.reserve(stops.size());
-        for (auto stop : stops)
+        coordinates.reserve(stops_.size());
+        for (auto stop : stops_)
         {
             coordinates.push_back(stop->coordinates);
         }
-        return SphereProjector(coordinates.begin(), coordinates.end(), config.width, config.height, config.padding);
+        const SphereProjector projector(coordinates.begin(), coordinates.end(), config.width, config.height, config.padding);
+
+        points_.resize(all_stops.empty() ? 0 : max_id + 1);
+        for (const auto stop : all_stops)
+        {
+            points_[stop->id] = projector(stop->coordinates);
+        }
+    }
+
+    bool StopProjection::Matches(uint64_t catalog_version, const RenderSettings &config) const
+    {
+        return catalog_version_ == catalog_version && width_ == config.width && height_ == config.height && padding_ == config.padding;
+    }
+
+    const std::vector<const domain::Stop *> &StopProjection::Stops() const
+    {
+        return stops_;
     }
 
     inline void MapRenderer::InitRenderSettingsRouteText(const std::string_view bus_name, std::vector<svg::Point> &points, domain::BusType typebus, size_t color_index)
@@ -147,7 +234,6 @@ namespace transport_catalog::svgreader
         if (typebus == domain::BusType::Line)
         {
             double x = size_points / 2.0;
-            // std::cout<<(int)(x + 0.5)<<std::endl;
             const auto &labelend = points.begin() + ((int)(x - 0.5));
             TextMapBus drw(*labelend, bus_name, renderSettings_, color_index);
             routelineText_[bus_name].push_back(std::move(drw));
@@ -166,23 +252,14 @@ namespace transport_catalog::svgreader
             }
 
             std::vector<svg::Point> points;
-            std::vector<std::pair<std::string_view, geo::Coordinates>> geo_coords;
-
             for (const auto &stop : bus_link->stops)
             {
                 if (*stop != domain::Stop{})
                 {
-                    geo_coords.push_back({stop->name, stop->coordinates});
+                    points.push_back((*projection_)(*stop));
                 }
             }
 
-            // Проецируем и выводим координаты
-            for (const auto geo_coord : geo_coords)
-            {
-                const svg::Point screen_coord = sphereProjector_(geo_coord.second);
-                points.push_back(screen_coord);
-            }
-
             domain::BusType typeLine = bus_link->view != bus_link->type && bus_link->stops.front() == bus_link->stops.back() ? domain::BusType::Ring : bus_link->type;
             InitRenderSettingsRouteText(bus_link->name, points, typeLine, color_index);
 
@@ -198,9 +275,9 @@ namespace transport_catalog::svgreader
 
             routeline_[bus_link->name].push_back(std::move(drw));
         }
-        for (const auto &buff : stops_)
+        for (const auto &buff : projection_->Stops())
         {
-            const svg::Point screen_coord = sphereProjector_(buff->coordinates);
+            const svg::Point screen_coord = (*projection_)(*buff);
             PointMap drw(screen_coord, renderSettings_);
             routelinePoint_.push_back(std::move(drw));
 
@@ -209,22 +286,693 @@ namespace transport_catalog::svgreader
         }
     }
 
-    MapRenderer::MapRenderer(const RenderSettings &config, std::vector<const domain::Bus *> &dictBus) : renderSettings_(config),
-                                                                                                        dictBus_(dictBus), stops_(ConvertBuses(dictBus)), sphereProjector_(GetSphere(stops_, config))
+    MapRenderer::MapRenderer(const RenderSettings &config, std::vector<const domain::Bus *> &dictBus,
+                             std::shared_ptr<const StopProjection> projection)
+        : renderSettings_(config), dictBus_(dictBus),
+          projection_(projection ? std::move(projection) : std::make_shared<const StopProjection>(dictBus, 0, config))
     {
 
         std::sort(dictBus_.begin(), dictBus_.end(), [](const domain::Bus *a, const domain::Bus *b)
                   { return a->name < b->name; });
-        InitRenderSettingsRoute();
     }
+
+    template <typename Func>
+    void MapRenderer::ForEachRoute(Func func) const
+    {
+        size_t color_index = 0;
+        for (const auto bus_link : dictBus_)
+        {
+            if (bus_link->stops.size() == 0)
+            {
+                continue;
+            }
+            func(*bus_link, color_index);
+            if (++color_index >= renderSettings_.color_palette.size())
+            {
+                color_index = 0;
+            }
+        }
+    }
+
+    namespace
+    {
+        // Общие для всех элементов карты части тегов, выводятся один раз при создании
+        struct MapStyle
+        {
+            explicit MapStyle(const RenderSettings &config)
+                : decimals(config.coordinate_decimals)
+            {
+                using namespace std::literals;
+                const auto render = [](auto print)
+                {
+                    std::ostringstream out;
+                    print(out);
+                    return out.str();
+                };
+                const auto number = [&config](std::ostream &out, double value)
+                {
+                    svg::RenderNumber(out, value, config.coordinate_decimals);
+                };
+                for (const auto &color : config.color_palette)
+                {
+                    route_attrs.push_back(render([&](std::ostream &out)
+                                                 {
+                                                     out << "\" fill=\"none\" stroke=\""sv << color << "\" stroke-width=\""sv;
+                                                     number(out, config.line_width);
+                                                     out << "\" stroke-linecap=\"round\" stroke-linejoin=\"round\"/>\n"sv; }));
+                    bus_label_fill.push_back(render([&](std::ostream &out)
+                                                    { out << "  <text fill=\""sv << color << "\" x=\""sv; }));
+                }
+                underlayer = render([&](std::ostream &out)
+                                    {
+                                        out << "  <text fill=\""sv << config.underlayer_color << "\" stroke=\""sv << config.underlayer_color
+                                            << "\" stroke-width=\""sv;
+                                        number(out, config.underlayer_width);
+                                        out << "\" stroke-linecap=\"round\" stroke-linejoin=\"round\" x=\""sv; });
+                const auto label_tail = [&](std::ostream &out, svg::Point offset, int font_size)
+                {
+                    out << "\" dx=\""sv;
+                    number(out, offset.x);
+                    out << "\" dy=\""sv;
+                    number(out, offset.y);
+                    out << "\" font-size=\""sv << static_cast<uint32_t>(font_size) << "\" font-family=\"Verdana\""sv;
+                };
+                bus_label_tail = render([&](std::ostream &out)
+                                        {
+                                            label_tail(out, config.bus_label_offset, config.bus_label_font_size);
+                                            out << " font-weight=\"bold\">"sv; });
+                stop_label_tail = render([&](std::ostream &out)
+                                         {
+                                             label_tail(out, config.stop_label_offset, config.stop_label_font_size);
+                                             out.put('>'); });
+                circle_tail = render([&](std::ostream &out)
+                                     {
+                                         out << "\" r=\""sv;
+                                         number(out, config.stop_radius);
+                                         out << "\" fill=\"white\"/>\n"sv; });
+            }
+
+            // Окончание <polyline> после points для каждого цвета палитры
+            std::vector<std::string> route_attrs;
+            // Начало <text> надписи маршрута до значения x для каждого цвета палитры
+            std::vector<std::string> bus_label_fill;
+            // Начало <text> подложки надписи до значения x
+            std::string underlayer;
+            // Атрибуты надписей после значения y, включая закрывающую скобку тега
+            std::string bus_label_tail;
+            std::string stop_label_tail;
+            // Окончание <circle> после значения cy
+            std::string circle_tail;
+            // Знаков после запятой у координат
+            int decimals;
+
+            // Выводит координаты точки через separator
+            void RenderCoordinates(std::ostream &out, svg::Point point, std::string_view separator) const
+            {
+                svg::RenderNumber(out, point.x, decimals);
+                out << separator;
+                svg::RenderNumber(out, point.y, decimals);
+            }
+
+        };
+
+        // Выводит точки ломаной через пробел в формате x,y
+        void RenderPoints(std::ostream &out, const MapStyle &style, const std::vector<svg::Point> &points)
+        {
+            for (size_t i = 0; i < points.size(); ++i)
+            {
+                if (i > 0)
+                {
+                    out.put(' ');
+                }
+                style.RenderCoordinates(out, points[i], ",");
+            }
+        }
+
+        void RenderLabel(std::ostream &out, const MapStyle &style, std::string_view head, svg::Point point, std::string_view tail, std::string_view text)
+        {
+            using namespace std::literals;
+            out << head;
+            style.RenderCoordinates(out, point, "\" y=\""sv);
+            out << tail;
+            svg::RenderEscapedText(out, text);
+            out << "</text>\n"sv;
+        }
+    }
+
+    void MapRenderer::RenderMap(std::ostream &out, ThreadPool *pool) const
+    {
+        // Цвет маршрута зависит от числа предыдущих, поэтому назначается заранее
+        std::vector<std::pair<const domain::Bus *, size_t>> routes;
+        ForEachRoute([&routes](const domain::Bus &bus, size_t color_index)
+                     { routes.emplace_back(&bus, color_index); });
+        RenderLayers(out, pool, routes, *projection_, projection_->Stops());
+    }
+
+    void MapRenderer::RenderSubset(std::ostream &out, const std::vector<const domain::Bus *> &buses, bool fit, ThreadPool *pool) const
+    {
+        // Маршруты сохраняют цвета полной карты
+        const std::unordered_set<const domain::Bus *> selected(buses.begin(), buses.end());
+        std::vector<std::pair<const domain::Bus *, size_t>> routes;
+        std::vector<const domain::Bus *> selected_buses;
+        ForEachRoute([&](const domain::Bus &bus, size_t color_index)
+                     {
+                         if (selected.count(&bus) > 0)
+                         {
+                             routes.emplace_back(&bus, color_index);
+                             selected_buses.push_back(&bus);
+                         } });
+
+        if (fit)
+        {
+            const StopProjection projection(selected_buses, 0, renderSettings_);
+            RenderLayers(out, pool, routes, projection, projection.Stops());
+            return;
+        }
+        std::unordered_set<std::string_view> stop_names;
+        for (const auto *bus : selected_buses)
+        {
+            for (const auto *stop : bus->stops)
+            {
+                stop_names.insert(stop->name);
+            }
+        }
+        std::vector<const domain::Stop *> stops;
+        std::copy_if(projection_->Stops().begin(), projection_->Stops().end(), std::back_inserter(stops), [&stop_names](const domain::Stop *stop)
+                     { return stop_names.count(stop->name) > 0; });
+        RenderLayers(out, pool, routes, *projection_, stops);
+    }
+
+    void MapRenderer::RenderLayers(std::ostream &out, ThreadPool *pool,
+                                   const std::vector<std::pair<const domain::Bus *, size_t>> &routes,
+                                   const StopProjection &projection, const std::vector<const domain::Stop *> &stops) const
+    {
+        using namespace std::literals;
+        const MapStyle style(renderSettings_);
+
+        // Слои карты в порядке вывода
+        enum Layer
+        {
+            ROUTE_LINES,
+            ROUTE_LABELS,
+            STOP_POINTS,
+            STOP_LABELS,
+            LAYER_COUNT,
+        };
+        const size_t layer_sizes[LAYER_COUNT] = {routes.size(), routes.size(), stops.size(), stops.size()};
+
+        // Спроецированные остановки маршрута без пустых
+        const auto route_points = [&projection](const domain::Bus &bus)
+        {
+            std::vector<svg::Point> points;
+            points.reserve(bus.stops.size());
+            for (const auto *stop : bus.stops)
+            {
+                if (*stop != domain::Stop{})
+                {
+                    points.push_back(projection(*stop));
+                }
+            }
+            return points;
+        };
+        const auto route_type = [](const domain::Bus &bus)
+        {
+            return bus.view != bus.type && bus.stops.front() == bus.stops.back() ? domain::BusType::Ring : bus.type;
+        };
+
+        // Выводит элемент index слоя layer в item_out: общий поток или буфер фрагмента
+        const auto render_item = [&](std::ostream &item_out, Layer layer, size_t index)
+        {
+            switch (layer)
+            {
+            case ROUTE_LINES:
+            {
+                const auto &[bus, color_index] = routes[index];
+                item_out << "  <polyline points=\""sv;
+                if (renderSettings_.simplify_tolerance > 0.0)
+                {
+                    RenderPoints(item_out, style, SimplifyPolyline(route_points(*bus), renderSettings_.simplify_tolerance));
+                }
+                else
+                {
+                    bool is_first = true;
+                    for (const auto *stop : bus->stops)
+                    {
+                        if (*stop == domain::Stop{})
+                        {
+                            continue;
+                        }
+                        const svg::Point point = projection(*stop);
+                        if (!is_first)
+                        {
+                            item_out.put(' ');
+                        }
+                        is_first = false;
+                        style.RenderCoordinates(item_out, point, ","sv);
+                    }
+                }
+                item_out << style.route_attrs[color_index];
+                break;
+            }
+            case ROUTE_LABELS:
+            {
+                // Названия маршрутов у конечных остановок
+                const auto &[bus, color_index] = routes[index];
+                std::vector<const domain::Stop *> bus_stops;
+                bus_stops.reserve(bus->stops.size());
+                std::copy_if(bus->stops.begin(), bus->stops.end(), std::back_inserter(bus_stops), [](const domain::Stop *stop)
+                             { return *stop != domain::Stop{}; });
+                if (bus_stops.size() <= 1)
+                {
+                    break;
+                }
+                const domain::BusType type = route_type(*bus);
+                const auto render_label = [&](const domain::Stop *stop)
+                {
+                    const svg::Point point = projection(*stop);
+                    RenderLabel(item_out, style, style.underlayer, point, style.bus_label_tail, bus->name);
+                    RenderLabel(item_out, style, style.bus_label_fill[color_index], point, style.bus_label_tail, bus->name);
+                };
+                render_label(bus_stops.front());
+                if (type == domain::BusType::Line)
+                {
+                    render_label(bus_stops[static_cast<int>(bus_stops.size() / 2.0 - 0.5)]);
+                }
+                break;
+            }
+            case STOP_POINTS:
+            {
+                const svg::Point point = projection(*stops[index]);
+                item_out << "  <circle cx=\""sv;
+                style.RenderCoordinates(item_out, point, "\" cy=\""sv);
+                item_out << style.circle_tail;
+                break;
+            }
+            case STOP_LABELS:
+            {
+                const svg::Point point = projection(*stops[index]);
+                RenderLabel(item_out, style, style.underlayer, point, style.stop_label_tail, stops[index]->name);
+                RenderLabel(item_out, style, "  <text fill=\"black\" x=\""sv, point, style.stop_label_tail, stops[index]->name);
+                break;
+            }
+            default:
+                break;
+            }
+        };
+
+        svg::RenderDocumentBegin(out);
+        if (pool == nullptr || pool->Size() == 1)
+        {
+            for (int layer = 0; layer < LAYER_COUNT; ++layer)
+            {
+                for (size_t i = 0; i < layer_sizes[layer]; ++i)
+                {
+                    render_item(out, static_cast<Layer>(layer), i);
+                }
+            }
+        }
+        else
+        {
+            // Каждый слой делится на фрагменты, которые выводятся параллельно
+            // в отдельные буферы и затем склеиваются в порядке слоёв
+            struct Fragment
+            {
+                Layer layer;
+                size_t begin;
+                size_t end;
+                std::string text;
+            };
+            std::vector<Fragment> fragments;
+            for (int layer = 0; layer < LAYER_COUNT; ++layer)
+            {
+                for (size_t begin = 0; begin < layer_sizes[layer]; begin += FRAGMENT_SIZE)
+                {
+                    fragments.push_back({static_cast<Layer>(layer), begin, std::min(layer_sizes[layer], begin + FRAGMENT_SIZE), {}});
+                }
+            }
+            pool->ParallelFor(fragments.size(), 1, [&](size_t begin, size_t end)
+                              {
+                                  for (size_t f = begin; f < end; ++f)
+                                  {
+                                      Fragment &fragment = fragments[f];
+                                      std::ostringstream fragment_out;
+                                      for (size_t i = fragment.begin; i < fragment.end; ++i)
+                                      {
+                                          render_item(fragment_out, fragment.layer, i);
+                                      }
+                                      fragment.text = std::move(fragment_out).str();
+                                  } });
+            for (const Fragment &fragment : fragments)
+            {
+                out << fragment.text;
+            }
+        }
+        svg::RenderDocumentEnd(out);
+    }
+
+    struct MapRenderer::TileIndex
+    {
+        struct Route
+        {
+            const domain::Bus *bus;
+            size_t color_index;
+            // Спроецированные остановки маршрута
+            std::vector<svg::Point> points;
+            // Номера точек, у которых выводится название маршрута
+            std::vector<size_t> labels;
+        };
+
+        std::vector<Route> routes;
+        // Остановки в порядке вывода и их проекции
+        std::vector<const domain::Stop *> stops;
+        std::vector<svg::Point> stop_points;
+
+        // Равномерная сетка над областью всех точек. В ячейке хранятся номера
+        // остановок и отрезков маршрутов (номер маршрута << 32 | номер отрезка)
+        double min_x = 0.0;
+        double min_y = 0.0;
+        double cell_width = 1.0;
+        double cell_height = 1.0;
+        size_t columns = 1;
+        size_t rows = 1;
+        std::vector<std::vector<uint32_t>> cell_stops;
+        std::vector<std::vector<uint64_t>> cell_segments;
+
+        // Диапазон ячеек [first, last], пересекающих область
+        std::pair<size_t, size_t> Columns(double from, double to) const
+        {
+            return {CellOf(from, min_x, cell_width, columns), CellOf(to, min_x, cell_width, columns)};
+        }
+        std::pair<size_t, size_t> Rows(double from, double to) const
+        {
+            return {CellOf(from, min_y, cell_height, rows), CellOf(to, min_y, cell_height, rows)};
+        }
+
+    private:
+        static size_t CellOf(double value, double origin, double size, size_t count)
+        {
+            const double cell = std::floor((value - origin) / size);
+            return static_cast<size_t>(std::clamp(cell, 0.0, static_cast<double>(count - 1)));
+        }
+    };
+
+    MapRenderer::~MapRenderer() = default;
+
+    const MapRenderer::TileIndex &MapRenderer::GetTileIndex() const
+    {
+        std::call_once(tile_index_once_, [this]
+                       {
+            auto index = std::make_unique<TileIndex>();
+            ForEachRoute([this, &index](const domain::Bus &bus, size_t color_index)
+                         {
+                TileIndex::Route route{&bus, color_index, {}, {}};
+                for (const auto *stop : bus.stops)
+                {
+                    if (*stop != domain::Stop{})
+                    {
+                        route.points.push_back((*projection_)(*stop));
+                    }
+                }
+                if (route.points.size() > 1)
+                {
+                    route.labels.push_back(0);
+                    const domain::BusType type = bus.view != bus.type && bus.stops.front() == bus.stops.back() ? domain::BusType::Ring : bus.type;
+                    if (type == domain::BusType::Line)
+                    {
+                        route.labels.push_back(static_cast<int>(route.points.size() / 2.0 - 0.5));
+                    }
+                }
+                index->routes.push_back(std::move(route)); });
+            for (const auto *stop : projection_->Stops())
+            {
+                index->stops.push_back(stop);
+                index->stop_points.push_back((*projection_)(*stop));
+            }
+
+            // Границы сетки — все точки карты
+            double max_x = 0.0, max_y = 0.0;
+            bool is_empty = true;
+            const auto extend = [&](svg::Point point)
+            {
+                if (is_empty)
+                {
+                    index->min_x = max_x = point.x;
+                    index->min_y = max_y = point.y;
+                    is_empty = false;
+                    return;
+                }
+                index->min_x = std::min(index->min_x, point.x);
+                index->min_y = std::min(index->min_y, point.y);
+                max_x = std::max(max_x, point.x);
+                max_y = std::max(max_y, point.y);
+            };
+            std::for_each(index->stop_points.begin(), index->stop_points.end(), extend);
+            for (const auto &route : index->routes)
+            {
+                std::for_each(route.points.begin(), route.points.end(), extend);
+            }
+            // В среднем около восьми остановок на ячейку
+            const size_t side = std::clamp<size_t>(static_cast<size_t>(std::sqrt(index->stops.size() / 8.0)), 1, 512);
+            index->columns = index->rows = side;
+            index->cell_width = std::max((max_x - index->min_x) / side, EPSILON);
+            index->cell_height = std::max((max_y - index->min_y) / side, EPSILON);
+            index->cell_stops.resize(side * side);
+            index->cell_segments.resize(side * side);
+
+            for (size_t i = 0; i < index->stops.size(); ++i)
+            {
+                const svg::Point point = index->stop_points[i];
+                const size_t column = index->Columns(point.x, point.x).first;
+                const size_t row = index->Rows(point.y, point.y).first;
+                index->cell_stops[row * side + column].push_back(static_cast<uint32_t>(i));
+            }
+            for (size_t r = 0; r < index->routes.size(); ++r)
+            {
+                const auto &points = index->routes[r].points;
+                // Маршрут из одной остановки — отрезок нулевой длины в её точке
+                const size_t segment_count = points.size() > 1 ? points.size() - 1 : points.size();
+                for (size_t i = 0; i < segment_count; ++i)
+                {
+                    const svg::Point next = points[std::min(i + 1, points.size() - 1)];
+                    const auto [first_column, last_column] = index->Columns(std::min(points[i].x, next.x), std::max(points[i].x, next.x));
+                    const auto [first_row, last_row] = index->Rows(std::min(points[i].y, next.y), std::max(points[i].y, next.y));
+                    for (size_t row = first_row; row <= last_row; ++row)
+                    {
+                        for (size_t column = first_column; column <= last_column; ++column)
+                        {
+                            index->cell_segments[row * side + column].push_back(static_cast<uint64_t>(r) << 32 | i);
+                        }
+                    }
+                }
+            }
+            tile_index_ = std::move(index); });
+        return *tile_index_;
+    }
+
+    Viewport MapRenderer::TileViewport(int z, int x, int y) const
+    {
+        const double tiles = std::ldexp(1.0, z);
+        const double width = renderSettings_.width / tiles;
+        const double height = renderSettings_.height / tiles;
+        return {x * width, y * height, (x + 1) * width, (y + 1) * height};
+    }
+
+    namespace
+    {
+        // Обрезает отрезок [from, to] по области (алгоритм Лианга — Барски).
+        // Возвращает false, если отрезок целиком вне области
+        bool ClipSegment(svg::Point &from, svg::Point &to, const Viewport &viewport, bool &from_clipped, bool &to_clipped)
+        {
+            const double dx = to.x - from.x;
+            const double dy = to.y - from.y;
+            const double p[] = {-dx, dx, -dy, dy};
+            const double q[] = {from.x - viewport.min_x, viewport.max_x - from.x, from.y - viewport.min_y, viewport.max_y - from.y};
+            double t0 = 0.0, t1 = 1.0;
+            for (int i = 0; i < 4; ++i)
+            {
+                if (p[i] == 0.0)
+                {
+                    if (q[i] < 0.0)
+                    {
+                        return false;
+                    }
+                    continue;
+                }
+                const double t = q[i] / p[i];
+                if (p[i] < 0.0)
+                {
+                    if (t > t1)
+                    {
+                        return false;
+                    }
+                    t0 = std::max(t0, t);
+                }
+                else
+                {
+                    if (t < t0)
+                    {
+                        return false;
+                    }
+                    t1 = std::min(t1, t);
+                }
+            }
+            // Необрезанные концы остаются точно такими же, как на полной карте
+            from_clipped = t0 > 0.0;
+            to_clipped = t1 < 1.0;
+            const svg::Point start = from;
+            if (from_clipped)
+            {
+                from = {start.x + t0 * dx, start.y + t0 * dy};
+            }
+            if (to_clipped)
+            {
+                to = {start.x + t1 * dx, start.y + t1 * dy};
+            }
+            return true;
+        }
+
+        bool Contains(const Viewport &viewport, svg::Point point)
+        {
+            return point.x >= viewport.min_x && point.x <= viewport.max_x && point.y >= viewport.min_y && point.y <= viewport.max_y;
+        }
+    }
+
+    void MapRenderer::RenderTile(std::ostream &out, const Viewport &viewport) const
+    {
+        using namespace std::literals;
+        const TileIndex &index = GetTileIndex();
+        const MapStyle style(renderSettings_);
+
+        // Область растягивается на всё изображение с сохранением пропорций
+        const double scale = std::min(renderSettings_.width / std::max(viewport.max_x - viewport.min_x, EPSILON),
+                                      renderSettings_.height / std::max(viewport.max_y - viewport.min_y, EPSILON));
+        const auto transform = [&viewport, scale](svg::Point point)
+        {
+            return svg::Point{(point.x - viewport.min_x) * scale, (point.y - viewport.min_y) * scale};
+        };
+        // Запас по краям, чтобы не терять частично видимые круги и толщину линий
+        const double margin = std::max({renderSettings_.stop_radius, renderSettings_.line_width / 2, renderSettings_.underlayer_width}) / scale;
+        const Viewport area{viewport.min_x - margin, viewport.min_y - margin, viewport.max_x + margin, viewport.max_y + margin};
+
+        const auto [first_column, last_column] = index.Columns(area.min_x, area.max_x);
+        const auto [first_row, last_row] = index.Rows(area.min_y, area.max_y);
+        std::vector<uint32_t> stops;
+        std::vector<uint64_t> segments;
+        for (size_t row = first_row; row <= last_row; ++row)
+        {
+            for (size_t column = first_column; column <= last_column; ++column)
+            {
+                const size_t cell = row * index.columns + column;
+                for (const uint32_t stop : index.cell_stops[cell])
+                {
+                    if (Contains(area, index.stop_points[stop]))
+                    {
+                        stops.push_back(stop);
+                    }
+                }
+                segments.insert(segments.end(), index.cell_segments[cell].begin(), index.cell_segments[cell].end());
+            }
+        }
+        // Номера упорядочены так же, как элементы полной карты
+        std::sort(stops.begin(), stops.end());
+        std::sort(segments.begin(), segments.end());
+        segments.erase(std::unique(segments.begin(), segments.end()), segments.end());
+
+        svg::RenderDocumentBegin(out);
+
+        // Линии маршрутов: непрерывные видимые участки выводятся отдельными ломаными
+        for (auto it = segments.begin(); it != segments.end();)
+        {
+            const size_t route_index = *it >> 32;
+            const auto &route = index.routes[route_index];
+            std::vector<svg::Point> run;
+            size_t last_segment = 0;
+            bool last_to_clipped = true;
+            // Маршрут из одной остановки выводится ломаной из одной точки, как на полной карте
+            const bool is_point = route.points.size() == 1;
+            const auto flush = [&]
+            {
+                if (run.size() > 1 || (is_point && !run.empty()))
+                {
+                    // Допуск упрощения задан в пикселях изображения, поэтому
+                    // применяется к уже масштабированным точкам
+                    std::transform(run.begin(), run.end(), run.begin(), transform);
+                    out << "  <polyline points=\""sv;
+                    RenderPoints(out, style, SimplifyPolyline(run, renderSettings_.simplify_tolerance));
+                    out << style.route_attrs[route.color_index];
+                }
+                run.clear();
+            };
+            for (; it != segments.end() && (*it >> 32) == route_index; ++it)
+            {
+                const size_t segment = *it & 0xFFFFFFFFu;
+                svg::Point from = route.points[segment];
+                svg::Point to = is_point ? from : route.points[segment + 1];
+                bool from_clipped = false, to_clipped = false;
+                if (!ClipSegment(from, to, area, from_clipped, to_clipped))
+                {
+                    continue;
+                }
+                const bool continues = !run.empty() && last_segment + 1 == segment && !last_to_clipped && !from_clipped;
+                if (!continues)
+                {
+                    flush();
+                    run.push_back(from);
+                }
+                if (!is_point)
+                {
+                    run.push_back(to);
+                }
+                last_segment = segment;
+                last_to_clipped = to_clipped;
+            }
+            flush();
+        }
+
+        // Названия маршрутов, точки привязки которых попали в область
+        for (const auto &route : index.routes)
+        {
+            for (const size_t label : route.labels)
+            {
+                if (Contains(area, route.points[label]))
+                {
+                    const svg::Point point = transform(route.points[label]);
+                    RenderLabel(out, style, style.underlayer, point, style.bus_label_tail, route.bus->name);
+                    RenderLabel(out, style, style.bus_label_fill[route.color_index], point, style.bus_label_tail, route.bus->name);
+                }
+            }
+        }
+
+        for (const uint32_t stop : stops)
+        {
+            const svg::Point point = transform(index.stop_points[stop]);
+            out << "  <circle cx=\""sv;
+            style.RenderCoordinates(out, point, "\" cy=\""sv);
+            out << style.circle_tail;
+        }
+        for (const uint32_t stop : stops)
+        {
+            const svg::Point point = transform(index.stop_points[stop]);
+            RenderLabel(out, style, style.underlayer, point, style.stop_label_tail, index.stops[stop]->name);
+            RenderLabel(out, style, "  <text fill=\"black\" x=\""sv, point, style.stop_label_tail, index.stops[stop]->name);
+        }
+
+        svg::RenderDocumentEnd(out);
+    }
+
     svg::Document MapRenderer::RenderMap()
     {
+        routeline_.clear();
+        routelineText_.clear();
+        routelinePoint_.clear();
+        routelinePointText_.clear();
+        InitRenderSettingsRoute();
+
         svg::Document doc;
+        doc.Reserve(routeline_.size() + routelineText_.size() * 4 + routelinePoint_.size() + routelinePointText_.size() * 2);
 
         for (const auto &[busname,pline ] : routeline_)
         {
-            // std::cout << "name" << k << std::endl;
-
             for (const RouteLine &a : pline)
             {
                 a.Draw(doc);
@@ -233,8 +981,6 @@ namespace transport_catalog::svgreader
 
         for (const auto &[busname, text] : routelineText_)
         {
-            // std::cout << "name" << k << std::endl;
-
             for (const TextMapBus &a : text)
             {
                 a.Draw(doc);
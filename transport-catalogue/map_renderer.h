@@ -2,6 +2,7 @@
 #include "domain.h"
 #include "geo.h"
 #include "svg.h"
+#include "thread_pool.h"
 
 #include <algorithm>
 #include <cstdlib>
@@ -9,7 +10,9 @@
 #include <optional>
 #include <utility>
 #include <memory>
+#include <cstdint>
 #include <map>
+#include <mutex>
 #include <vector>
 
 namespace transport_catalog::svgreader
@@ -28,11 +31,28 @@ namespace transport_catalog::svgreader
         svg::Color underlayer_color;
         double underlayer_width = 0.0;
         std::vector<svg::Color> color_palette;
+        // Допуск упрощения линий маршрутов в пикселях, 0 — без упрощения
+        double simplify_tolerance = 0.0;
+        // Знаков после запятой у координат, svg::AUTO_DECIMALS — 6 значащих цифр
+        int coordinate_decimals = svg::AUTO_DECIMALS;
+    };
+
+    // Прямоугольная область полного изображения карты
+    struct Viewport
+    {
+        double min_x = 0.0;
+        double min_y = 0.0;
+        double max_x = 0.0;
+        double max_y = 0.0;
     };
 
     inline const double EPSILON = 1e-6;
     bool IsZero(double value);
 
+    // Удаляет точки ломаной, отстоящие от упрощённой линии не больше чем на tolerance.
+    // Крайние точки сохраняются, при tolerance <= 0 ломаная не меняется
+    std::vector<svg::Point> SimplifyPolyline(const std::vector<svg::Point> &points, double tolerance);
+
     class SphereProjector
     {
     public:
@@ -106,6 +126,37 @@ namespace transport_catalog::svgreader
         double zoom_coeff_ = 0;
     };
 
+    /*
+     * Экранные координаты остановок маршрутов, вычисленные один раз для версии
+     * справочника и геометрии карты (width, height, padding). Хранятся в массиве
+     * по номеру остановки в справочнике и общие для всех отрисовок карты и плиток
+     */
+    class StopProjection
+    {
+    public:
+        StopProjection(const std::vector<const domain::Bus *> &buses, uint64_t catalog_version, const RenderSettings &config);
+
+        // Подходит ли проекция для данной версии справочника и настроек
+        bool Matches(uint64_t catalog_version, const RenderSettings &config) const;
+
+        // Остановки маршрутов без повторов, упорядоченные по названию
+        const std::vector<const domain::Stop *> &Stops() const;
+
+        // Остановка должна входить в один из маршрутов
+        svg::Point operator()(const domain::Stop &stop) const
+        {
+            return points_[stop.id];
+        }
+
+    private:
+        uint64_t catalog_version_;
+        double width_;
+        double height_;
+        double padding_;
+        std::vector<const domain::Stop *> stops_;
+        std::vector<svg::Point> points_;
+    };
+
     class RouteLine : public svg::Drawable
     {
 
@@ -160,13 +211,6 @@ namespace transport_catalog::svgreader
     class MapRenderer
     {
         using LabelCoordinates = std::pair<std::string_view, geo::Coordinates*>;
-        struct StopComparator
-        {
-            bool operator()(const domain::Stop *lhs, const domain::Stop *rhs) const
-            {
-                return lhs->name < rhs->name;
-            }
-        };
         struct PointComparator
         {
             bool operator()(const LabelCoordinates* lhs, const LabelCoordinates *rhs) const
@@ -175,17 +219,44 @@ namespace transport_catalog::svgreader
             }
         };
         using ArrayCoordinates = std::set<const LabelCoordinates ,MapRenderer::PointComparator>;
-        using StopSet = std::set<const domain::Stop *, MapRenderer::StopComparator>;
 
     public:
-        MapRenderer(const RenderSettings &config, std::vector<const domain::Bus *> &dictBus);
-        StopSet ConvertBuses(std::vector<const domain::Bus *> &dictBus);
+        // Без готовой проекции она вычисляется по маршрутам dictBus
+        MapRenderer(const RenderSettings &config, std::vector<const domain::Bus *> &dictBus,
+                    std::shared_ptr<const StopProjection> projection = nullptr);
         svg::Document RenderMap();
-        SphereProjector GetSphere(const MapRenderer::StopSet &stops, const RenderSettings &config) const;
+        // Выводит карту в out сразу в виде SVG, обходя маршруты и остановки
+        // без промежуточных фигур и svg::Document. С пулом слои выводятся
+        // параллельно по фрагментам, результат совпадает с последовательным
+        void RenderMap(std::ostream &out, ThreadPool *pool = nullptr) const;
+        // Выводит только маршруты buses и их остановки в цветах полной карты. Проекция
+        // берётся от полной карты или, с fit, строится заново по выбранным маршрутам
+        void RenderSubset(std::ostream &out, const std::vector<const domain::Bus *> &buses, bool fit, ThreadPool *pool = nullptr) const;
+        // Область плитки z/x/y: изображение width × height делится на 2^z × 2^z равных частей
+        Viewport TileViewport(int z, int x, int y) const;
+        // Выводит часть карты внутри viewport, растянутую до размеров width × height.
+        // Элементы выбираются по пространственному индексу, линии маршрутов обрезаются
+        // по границе области. Индекс строится при первом вызове, метод потокобезопасен
+        void RenderTile(std::ostream &out, const Viewport &viewport) const;
+        ~MapRenderer();
         inline void InitRenderSettingsRoute();
         inline void InitRenderSettingsRouteText(const std::string_view bus_name, std::vector<svg::Point> &points, domain::BusType typebus, size_t color_index);
+        // Вызывает func(bus, color_index) для маршрутов с остановками в порядке вывода
+        template <typename Func>
+        void ForEachRoute(Func func) const;
         // Data members
     private:
+        // Число элементов слоя в одном фрагменте параллельного вывода
+        static constexpr size_t FRAGMENT_SIZE = 256;
+        // Выводит слои карты: маршруты с номерами цветов и остановки в порядке вывода
+        void RenderLayers(std::ostream &out, ThreadPool *pool,
+                          const std::vector<std::pair<const domain::Bus *, size_t>> &routes,
+                          const StopProjection &projection, const std::vector<const domain::Stop *> &stops) const;
+        // Спроецированные маршруты и остановки с сеткой для выбора по области
+        struct TileIndex;
+        const TileIndex &GetTileIndex() const;
+        mutable std::once_flag tile_index_once_;
+        mutable std::unique_ptr<TileIndex> tile_index_;
         // Data members
         std::map<std::string_view, std::vector<RouteLine>> routeline_;
         std::map<std::string_view, std::vector<TextMapBus>> routelineText_;
@@ -194,7 +265,6 @@ namespace transport_catalog::svgreader
         
         RenderSettings renderSettings_;
         std::vector<const domain::Bus *> &dictBus_;
-        StopSet stops_ ;
-        SphereProjector sphereProjector_;
+        std::shared_ptr<const StopProjection> projection_;
     };
 }
\ No newline at end of file
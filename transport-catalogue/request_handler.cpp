@@ -0,0 +1,236 @@
+#include "request_handler.h"
+
+#include <algorithm>
+
+namespace transport_catalog::request_handler
+{
+    namespace
+    {
+        // Встроенные виды занимают первые номера таблицы
+        const std::string_view BUILTIN_TYPES[] = {"Stop", "Bus", "Map"};
+    }
+
+    RequestHandler::RequestHandler(const TransportCatalogue &catalogue) : catalogue_(catalogue)
+    {
+        for (size_t kind = 0; kind < std::size(BUILTIN_TYPES); ++kind)
+        {
+            kinds_.emplace(std::string(BUILTIN_TYPES[kind]), static_cast<RequestKind>(kind));
+        }
+        handlers_.resize(std::size(BUILTIN_TYPES));
+        costs_.resize(std::size(BUILTIN_TYPES), CostClass::Lookup);
+    }
+
+    RequestKind RequestHandler::Register(std::string_view type, Handler handler, CostClass cost)
+    {
+        auto [it, inserted] = kinds_.emplace(std::string(type), static_cast<RequestKind>(handlers_.size()));
+        if (inserted)
+        {
+            handlers_.emplace_back();
+            costs_.emplace_back();
+        }
+        handlers_[static_cast<size_t>(it->second)] = std::move(handler);
+        costs_[static_cast<size_t>(it->second)] = cost;
+        return it->second;
+    }
+
+    CostClass RequestHandler::Classify(const json::Node &request) const
+    {
+        if (!request.IsDict())
+        {
+            return CostClass::Lookup;
+        }
+        const json::Dict &dict = request.AsDict();
+        const auto type = dict.find("type");
+        if (type == dict.end() || !type->second.IsString())
+        {
+            return CostClass::Lookup;
+        }
+        const auto kind = kinds_.find(type->second.AsString());
+        return kind == kinds_.end() ? CostClass::Lookup : costs_[static_cast<size_t>(kind->second)];
+    }
+
+    StatRequest RequestHandler::Decode(const json::Node &request) const
+    {
+        const json::Dict &dict = request.AsDict();
+        StatRequest result;
+        result.id = dict.at("id").AsInt();
+        result.params = &dict;
+
+        const auto kind = kinds_.find(dict.at("type").AsString());
+        if (kind != kinds_.end())
+        {
+            result.kind = kind->second;
+        }
+
+        // Имя, если оно есть, должно быть строкой; запросам Stop и Bus оно обязательно
+        if (dict.count("name") > 0 || result.kind == RequestKind::Stop || result.kind == RequestKind::Bus)
+        {
+            result.name = dict.at("name").AsString();
+            if (result.kind == RequestKind::Stop)
+            {
+                if (const auto *stop = catalogue_.FindStop(result.name); *stop != Stop{})
+                {
+                    result.name = stop->name;
+                }
+            }
+            else if (result.kind == RequestKind::Bus)
+            {
+                if (const auto *bus = catalogue_.FindBus(result.name); *bus != Bus{})
+                {
+                    result.name = bus->name;
+                }
+            }
+        }
+        return result;
+    }
+
+    void RequestHandler::Answer(const StatRequest &request, json::Writer &writer) const
+    {
+        writer.StartDict().Key("request_id").Value(request.id);
+        const auto kind = static_cast<size_t>(request.kind);
+        if (kind < handlers_.size() && handlers_[kind])
+        {
+            handlers_[kind](request, writer);
+        }
+        writer.EndDict();
+    }
+
+    AnswerCache::AnswerCache(const RequestHandler &handler, const json::PrintSettings &settings)
+        : handler_(handler), settings_(settings)
+    {
+    }
+
+    size_t AnswerCache::KeyHasher::operator()(const Key &key) const
+    {
+        std::hash<std::string> hasher;
+        return static_cast<size_t>(key.kind) + hasher(key.name) * 37 + hasher(key.params) * 37 * 37;
+    }
+
+    AnswerCache::Key AnswerCache::MakeKey(const StatRequest &request) const
+    {
+        Key key{request.kind, std::string(request.name), {}};
+        if (request.params == nullptr || request.kind == RequestKind::Stop || request.kind == RequestKind::Bus)
+        {
+            return key;
+        }
+        json::PrintSettings compact;
+        compact.pretty = false;
+        json::OutputSink sink(key.params);
+        json::Writer writer(sink, compact);
+        writer.StartDict();
+        for (const auto &[name, value] : *request.params)
+        {
+            if (name != "id" && name != "type" && name != "name")
+            {
+                writer.Key(name).Value(value);
+            }
+        }
+        writer.EndDict();
+        return key;
+    }
+
+    AnswerCache::Serialized AnswerCache::Serialize(const StatRequest &request) const
+    {
+        Serialized result;
+        {
+            json::OutputSink sink(result.text);
+            json::Writer writer(sink, settings_, 1);
+            handler_.Answer(request, writer);
+        }
+        // request_id выводится первым ключом, его значение заменяется при повторном выводе
+        char id[json::MAX_NUMBER_LENGTH];
+        const std::string_view id_text(id, json::FormatNumber(id, request.id) - id);
+        const size_t key_pos = result.text.find("\"request_id\"");
+        result.id_begin = result.text.find(id_text, key_pos);
+        result.id_end = result.id_begin + id_text.size();
+        return result;
+    }
+
+    void AnswerCache::Store(const Key &key, size_t bytes)
+    {
+        std::lock_guard lock(mutex_);
+        const auto it = answers_.find(key);
+        if (it == answers_.end())
+        {
+            return;
+        }
+        it->second.bytes = bytes;
+        cached_bytes_ += bytes;
+        // Вычисляемые ответы не вытесняются: их ждут другие потоки
+        for (auto position = order_.end(); cached_bytes_ > MAX_CACHED_BYTES && position != order_.begin();)
+        {
+            --position;
+            const auto entry = answers_.find(**position);
+            if (entry->second.bytes == 0)
+            {
+                continue;
+            }
+            cached_bytes_ -= entry->second.bytes;
+            position = order_.erase(position);
+            answers_.erase(entry);
+        }
+    }
+
+    void AnswerCache::Forget(const Key &key)
+    {
+        std::lock_guard lock(mutex_);
+        if (const auto it = answers_.find(key); it != answers_.end())
+        {
+            order_.erase(it->second.position);
+            answers_.erase(it);
+        }
+    }
+
+    void AnswerCache::Answer(const StatRequest &request, json::Writer &writer)
+    {
+        Key key = MakeKey(request);
+        std::shared_future<std::shared_ptr<const Serialized>> answer;
+        std::promise<std::shared_ptr<const Serialized>> promise;
+        bool compute = false;
+        {
+            std::lock_guard lock(mutex_);
+            auto [it, inserted] = answers_.try_emplace(key);
+            if (inserted)
+            {
+                it->second.answer = promise.get_future().share();
+                it->second.position = order_.insert(order_.begin(), &it->first);
+                compute = true;
+            }
+            else
+            {
+                order_.splice(order_.begin(), order_, it->second.position);
+            }
+            answer = it->second.answer;
+        }
+        if (compute)
+        {
+            // Ответ вычисляет первый запросивший поток, остальные ждут его результата
+            size_t bytes = 0;
+            try
+            {
+                auto serialized = std::make_shared<const Serialized>(Serialize(request));
+                bytes = std::max<size_t>(serialized->text.size(), 1);
+                promise.set_value(std::move(serialized));
+            }
+            catch (...)
+            {
+                promise.set_exception(std::current_exception());
+            }
+            if (bytes > 0)
+            {
+                Store(key, bytes);
+            }
+            else
+            {
+                Forget(key);
+            }
+        }
+
+        const Serialized &serialized = *answer.get();
+        const std::string_view text = serialized.text;
+        char id[json::MAX_NUMBER_LENGTH];
+        writer.RawValue({text.substr(0, serialized.id_begin),
+                         std::string_view(id, json::FormatNumber(id, request.id) - id),
+                         text.substr(serialized.id_end)});
+    }
+}
@@ -0,0 +1,148 @@
+#pragma once
+#include "json.h"
+#include "json_writer.h"
+#include "transport_catalogue.h"
+
+#include <functional>
+#include <list>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace transport_catalog::request_handler
+{
+    // Вид stat-запроса. Встроенные виды перечислены здесь,
+    // новые получают номера при регистрации обработчика
+    enum class RequestKind : uint32_t
+    {
+        Stop,
+        Bus,
+        Map,
+        Unknown = UINT32_MAX,
+    };
+
+    // Стоимость ответа: быстрый поиск по справочнику или тяжёлая отрисовка
+    enum class CostClass
+    {
+        Lookup,
+        Render,
+    };
+
+    // stat-запрос, разобранный один раз
+    struct StatRequest
+    {
+        int id = 0;
+        RequestKind kind = RequestKind::Unknown;
+        // Имя остановки или маршрута. Для найденных в справочнике объектов
+        // указывает в хранилище справочника, иначе — в исходный запрос
+        std::string_view name;
+        // Исходный запрос для обработчиков с дополнительными параметрами
+        const json::Dict *params = nullptr;
+    };
+
+    /*
+     * Таблица обработчиков stat-запросов по их виду.
+     * Обработчик выводит поля ответа после request_id
+     */
+    class RequestHandler
+    {
+    public:
+        using Handler = std::function<void(const StatRequest &request, json::Writer &writer)>;
+
+        explicit RequestHandler(const TransportCatalogue &catalogue);
+
+        // Регистрирует обработчик запросов с "type" == type и возвращает их вид
+        RequestKind Register(std::string_view type, Handler handler, CostClass cost = CostClass::Lookup);
+
+        // Класс стоимости по полю "type" без полного разбора запроса.
+        // Для некорректных запросов возвращает Lookup, ошибку сообщит Decode
+        CostClass Classify(const json::Node &request) const;
+
+        // Бросает исключение, если в запросе нет id или type
+        StatRequest Decode(const json::Node &request) const;
+
+        // Выводит словарь ответа целиком
+        void Answer(const StatRequest &request, json::Writer &writer) const;
+
+    private:
+        const TransportCatalogue &catalogue_;
+        std::unordered_map<std::string, RequestKind> kinds_;
+        std::vector<Handler> handlers_;
+        std::vector<CostClass> costs_;
+    };
+
+    /*
+     * Кэш ответов одного пакета запросов. Одинаковые запросы (вид, имя и прочие
+     * параметры, кроме id) вычисляются и сериализуются один раз, а готовые байты
+     * повторно выводятся под каждым request_id. Объём хранимых ответов ограничен
+     * MAX_CACHED_BYTES, давно не запрашивавшиеся вытесняются первыми.
+     * Безопасен для нескольких потоков
+     */
+    class AnswerCache
+    {
+    public:
+        static constexpr size_t MAX_CACHED_BYTES = 64 << 20;
+
+        AnswerCache(const RequestHandler &handler, const json::PrintSettings &settings);
+
+        // Выводит ответ как очередной элемент корневого массива writer
+        void Answer(const StatRequest &request, json::Writer &writer);
+
+    private:
+        struct Key
+        {
+            RequestKind kind;
+            std::string name;
+            // Прочие параметры запроса в компактной записи JSON.
+            // Пусты для Stop и Bus: их ответ зависит только от имени
+            std::string params;
+
+            bool operator==(const Key &other) const
+            {
+                return kind == other.kind && name == other.name && params == other.params;
+            }
+        };
+
+        struct KeyHasher
+        {
+            size_t operator()(const Key &key) const;
+        };
+
+        // Сериализованный ответ, разрезанный по значению request_id
+        struct Serialized
+        {
+            std::string text;
+            size_t id_begin = 0;
+            size_t id_end = 0;
+        };
+
+        struct Entry
+        {
+            std::shared_future<std::shared_ptr<const Serialized>> answer;
+            // Размер готового ответа; 0, пока ответ вычисляется
+            size_t bytes = 0;
+            // Место в очереди вытеснения
+            std::list<const Key *>::iterator position;
+        };
+
+        Key MakeKey(const StatRequest &request) const;
+        Serialized Serialize(const StatRequest &request) const;
+        // Учитывает размер готового ответа и вытесняет старые ответы сверх лимита
+        void Store(const Key &key, size_t bytes);
+        // Удаляет ответ, вычисление которого завершилось исключением: повторный
+        // запрос вычисляется заново, ожидающие потоки получают исключение
+        void Forget(const Key &key);
+
+        const RequestHandler &handler_;
+        const json::PrintSettings settings_;
+        std::mutex mutex_;
+        std::unordered_map<Key, Entry, KeyHasher> answers_;
+        // Ключи от недавно запрошенных к давно не запрашивавшимся
+        std::list<const Key *> order_;
+        size_t cached_bytes_ = 0;
+    };
+}
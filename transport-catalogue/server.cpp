@@ -0,0 +1,611 @@
+#include "server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace transport_catalog::server
+{
+    using namespace std::literals;
+
+    namespace
+    {
+        constexpr uint64_t LISTEN_ID = 0;
+        constexpr uint64_t EVENT_ID = 1;
+        constexpr size_t READ_CHUNK = 1 << 16;
+        constexpr std::string_view TOO_MANY_CONNECTIONS = "{\"error_message\":\"too many connections\"}\n"sv;
+
+        void Check(int result, const char *what)
+        {
+            if (result < 0)
+            {
+                throw std::system_error(errno, std::generic_category(), what);
+            }
+        }
+
+        // Заполняет адрес сокета и возвращает его длину
+        socklen_t MakeAddress(const Endpoint &endpoint, sockaddr_storage &storage)
+        {
+            std::memset(&storage, 0, sizeof(storage));
+            if (endpoint.is_unix)
+            {
+                auto &address = reinterpret_cast<sockaddr_un &>(storage);
+                if (endpoint.path.size() >= sizeof(address.sun_path))
+                {
+                    throw std::invalid_argument("Unix socket path is too long"s);
+                }
+                address.sun_family = AF_UNIX;
+                std::copy(endpoint.path.begin(), endpoint.path.end(), address.sun_path);
+                return sizeof(address);
+            }
+            auto &address = reinterpret_cast<sockaddr_in &>(storage);
+            address.sin_family = AF_INET;
+            address.sin_port = htons(static_cast<uint16_t>(endpoint.port));
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            return sizeof(address);
+        }
+
+        int OpenListener(const Endpoint &endpoint)
+        {
+            sockaddr_storage storage;
+            const socklen_t length = MakeAddress(endpoint, storage);
+            const int fd = socket(storage.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            Check(fd, "socket");
+            if (endpoint.is_unix)
+            {
+                unlink(endpoint.path.c_str());
+            }
+            else
+            {
+                const int on = 1;
+                setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+            }
+            if (bind(fd, reinterpret_cast<sockaddr *>(&storage), length) < 0 || listen(fd, SOMAXCONN) < 0)
+            {
+                const int error = errno;
+                close(fd);
+                throw std::system_error(error, std::generic_category(), "bind/listen");
+            }
+            return fd;
+        }
+
+        int Connect(const Endpoint &endpoint)
+        {
+            sockaddr_storage storage;
+            const socklen_t length = MakeAddress(endpoint, storage);
+            const int fd = socket(storage.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            Check(fd, "socket");
+            if (connect(fd, reinterpret_cast<sockaddr *>(&storage), length) < 0)
+            {
+                const int error = errno;
+                close(fd);
+                throw std::system_error(error, std::generic_category(), "connect");
+            }
+            if (!endpoint.is_unix)
+            {
+                const int on = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            }
+            return fd;
+        }
+
+        void SendAll(int fd, std::string_view data)
+        {
+            while (!data.empty())
+            {
+                const ssize_t sent = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+                if (sent < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                Check(static_cast<int>(sent), "send");
+                data.remove_prefix(static_cast<size_t>(sent));
+            }
+        }
+    }
+
+    Endpoint ParseEndpoint(std::string_view spec)
+    {
+        Endpoint endpoint;
+        if (spec.substr(0, 5) == "unix:"sv && spec.size() > 5)
+        {
+            endpoint.is_unix = true;
+            endpoint.path = std::string(spec.substr(5));
+            return endpoint;
+        }
+        if (spec.substr(0, 4) == "tcp:"sv)
+        {
+            endpoint.is_unix = false;
+            const std::string port(spec.substr(4));
+            size_t parsed = 0;
+            try
+            {
+                endpoint.port = std::stoi(port, &parsed);
+            }
+            catch (const std::exception &)
+            {
+                parsed = 0;
+            }
+            if (parsed == port.size() && endpoint.port > 0 && endpoint.port < 65536)
+            {
+                return endpoint;
+            }
+        }
+        throw std::invalid_argument("Bad endpoint '"s + std::string(spec) + "', expected unix:PATH or tcp:PORT"s);
+    }
+
+    Server::Server(ServerSettings settings, RequestHandler handler)
+        : settings_(std::move(settings)), handler_(std::move(handler)), next_connection_id_(EVENT_ID + 1), pool_(std::make_unique<ThreadPool>(settings_.workers))
+    {
+        settings_.max_in_flight = std::max<size_t>(settings_.max_in_flight, 1);
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        Check(epoll_fd_, "epoll_create1");
+        event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        Check(event_fd_, "eventfd");
+        listen_fd_ = OpenListener(settings_.endpoint);
+
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.u64 = LISTEN_ID;
+        Check(epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &event), "epoll_ctl");
+        event.data.u64 = EVENT_ID;
+        Check(epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, event_fd_, &event), "epoll_ctl");
+    }
+
+    Server::~Server()
+    {
+        pool_.reset();
+        for (auto &[id, connection] : connections_)
+        {
+            close(connection.fd);
+        }
+        close(listen_fd_);
+        close(event_fd_);
+        close(epoll_fd_);
+        if (settings_.endpoint.is_unix)
+        {
+            unlink(settings_.endpoint.path.c_str());
+        }
+    }
+
+    void Server::Stop()
+    {
+        stopping_ = true;
+        const uint64_t one = 1;
+        [[maybe_unused]] const auto written = write(event_fd_, &one, sizeof(one));
+    }
+
+    void Server::Run()
+    {
+        std::vector<epoll_event> events(256);
+        while (!stopping_)
+        {
+            const int count = epoll_wait(epoll_fd_, events.data(), static_cast<int>(events.size()), -1);
+            if (count < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            Check(count, "epoll_wait");
+
+            for (int i = 0; i < count; ++i)
+            {
+                const uint64_t id = events[i].data.u64;
+                if (id == LISTEN_ID)
+                {
+                    Accept();
+                    continue;
+                }
+                if (id == EVENT_ID)
+                {
+                    DrainCompletions();
+                    continue;
+                }
+                auto it = connections_.find(id);
+                if (it == connections_.end())
+                {
+                    continue;
+                }
+                // EPOLLHUP сообщается всегда, даже для приостановленного соединения
+                // без EPOLLIN. Клиент закрыл соединение в обе стороны, и доставить
+                // ответы некуда, поэтому соединение закрывается сразу
+                if (events[i].events & (EPOLLERR | EPOLLHUP))
+                {
+                    Close(id);
+                    continue;
+                }
+                if (events[i].events & EPOLLIN)
+                {
+                    Read(id, it->second);
+                }
+                it = connections_.find(id);
+                if (it != connections_.end() && (events[i].events & EPOLLOUT))
+                {
+                    Write(id, it->second);
+                }
+            }
+        }
+    }
+
+    void Server::Accept()
+    {
+        while (true)
+        {
+            const int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0)
+            {
+                if (errno == EINTR || errno == ECONNABORTED)
+                {
+                    continue;
+                }
+                return;
+            }
+            if (connections_.size() >= settings_.max_connections)
+            {
+                [[maybe_unused]] const auto sent = send(fd, TOO_MANY_CONNECTIONS.data(), TOO_MANY_CONNECTIONS.size(), MSG_NOSIGNAL);
+                close(fd);
+                continue;
+            }
+            const uint64_t id = next_connection_id_++;
+            Connection &connection = connections_[id];
+            connection.fd = fd;
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.u64 = id;
+            if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0)
+            {
+                close(fd);
+                connections_.erase(id);
+                continue;
+            }
+            connection.events = EPOLLIN;
+        }
+    }
+
+    void Server::Read(uint64_t id, Connection &connection)
+    {
+        char buffer[READ_CHUNK];
+        while (!connection.paused)
+        {
+            const ssize_t received = recv(connection.fd, buffer, sizeof(buffer), 0);
+            if (received > 0)
+            {
+                connection.input.append(buffer, static_cast<size_t>(received));
+                Dispatch(id, connection);
+                if (connection.input.size() > settings_.max_request_size)
+                {
+                    Close(id);
+                    return;
+                }
+                continue;
+            }
+            if (received < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                break;
+            }
+            // Клиент закрыл соединение или произошла ошибка
+            connection.read_closed = true;
+            break;
+        }
+        if (connection.read_closed && connection.in_flight == 0 && connection.output.empty())
+        {
+            Close(id);
+            return;
+        }
+        UpdateEvents(id, connection);
+    }
+
+    // Отправляет в пул все полные строки из входного буфера, пока не достигнут лимит
+    void Server::Dispatch(uint64_t id, Connection &connection)
+    {
+        size_t begin = 0;
+        while (in_flight_ < settings_.max_in_flight)
+        {
+            const size_t end = connection.input.find('\n', begin);
+            if (end == std::string::npos)
+            {
+                break;
+            }
+            std::string line = connection.input.substr(begin, end - begin);
+            begin = end + 1;
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+            if (line.find_first_not_of(" \t"sv) == std::string::npos)
+            {
+                continue;
+            }
+
+            const uint64_t seq = connection.next_seq++;
+            ++connection.in_flight;
+            ++in_flight_;
+            pool_->Post([this, id, seq, line = std::move(line)]
+                       {
+                           std::string answer;
+                           try
+                           {
+                               answer = handler_(line);
+                           }
+                           catch (...)
+                           {
+                               answer = "{\"error_message\":\"internal error\"}"s;
+                           }
+                           {
+                               std::lock_guard lock(completions_mutex_);
+                               completions_.push_back({id, seq, std::move(answer)});
+                           }
+                           const uint64_t one = 1;
+                           [[maybe_unused]] const auto written = write(event_fd_, &one, sizeof(one)); });
+        }
+        connection.input.erase(0, begin);
+
+        const bool was_paused = connection.paused;
+        connection.paused = in_flight_ >= settings_.max_in_flight && connection.input.find('\n') != std::string::npos;
+        if (connection.paused)
+        {
+            paused_.insert(id);
+        }
+        else if (was_paused)
+        {
+            paused_.erase(id);
+        }
+    }
+
+    void Server::DrainCompletions()
+    {
+        uint64_t counter = 0;
+        [[maybe_unused]] const auto read_bytes = read(event_fd_, &counter, sizeof(counter));
+
+        std::vector<Completion> completions;
+        {
+            std::lock_guard lock(completions_mutex_);
+            completions.swap(completions_);
+        }
+
+        std::unordered_set<uint64_t> touched;
+        for (Completion &completion : completions)
+        {
+            --in_flight_;
+            const auto it = connections_.find(completion.connection_id);
+            if (it == connections_.end())
+            {
+                continue;
+            }
+            Connection &connection = it->second;
+            --connection.in_flight;
+            connection.ready.emplace(completion.seq, std::move(completion.answer));
+            // Переносим в выходной буфер ответы, идущие подряд
+            for (auto ready = connection.ready.begin(); ready != connection.ready.end() && ready->first == connection.next_send;
+                 ready = connection.ready.erase(ready))
+            {
+                connection.output += ready->second;
+                connection.output.push_back('\n');
+                ++connection.next_send;
+            }
+            touched.insert(completion.connection_id);
+        }
+
+        for (const uint64_t id : touched)
+        {
+            if (const auto it = connections_.find(id); it != connections_.end())
+            {
+                Write(id, it->second);
+            }
+        }
+
+        // Освободились места для новых запросов: продолжаем приостановленные соединения
+        const std::vector<uint64_t> paused(paused_.begin(), paused_.end());
+        for (const uint64_t id : paused)
+        {
+            if (in_flight_ >= settings_.max_in_flight)
+            {
+                break;
+            }
+            if (const auto it = connections_.find(id); it != connections_.end())
+            {
+                Dispatch(id, it->second);
+                UpdateEvents(id, it->second);
+            }
+        }
+    }
+
+    void Server::Write(uint64_t id, Connection &connection)
+    {
+        while (connection.output_pos < connection.output.size())
+        {
+            const ssize_t sent = send(connection.fd, connection.output.data() + connection.output_pos,
+                                      connection.output.size() - connection.output_pos, MSG_NOSIGNAL);
+            if (sent < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    break;
+                }
+                Close(id);
+                return;
+            }
+            connection.output_pos += static_cast<size_t>(sent);
+        }
+        if (connection.output_pos == connection.output.size())
+        {
+            connection.output.clear();
+            connection.output_pos = 0;
+            if (connection.read_closed && connection.in_flight == 0)
+            {
+                Close(id);
+                return;
+            }
+        }
+        UpdateEvents(id, connection);
+    }
+
+    void Server::UpdateEvents(uint64_t id, Connection &connection)
+    {
+        uint32_t events = 0;
+        if (!connection.read_closed && !connection.paused)
+        {
+            events |= EPOLLIN;
+        }
+        if (!connection.output.empty())
+        {
+            events |= EPOLLOUT;
+        }
+        if (events == connection.events)
+        {
+            return;
+        }
+        epoll_event event{};
+        event.events = events;
+        event.data.u64 = id;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, connection.fd, &event);
+        connection.events = events;
+    }
+
+    void Server::Close(uint64_t id)
+    {
+        const auto it = connections_.find(id);
+        if (it == connections_.end())
+        {
+            return;
+        }
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, it->second.fd, nullptr);
+        close(it->second.fd);
+        paused_.erase(id);
+        connections_.erase(it);
+    }
+
+    LoadTestResult RunLoadTest(const LoadTestSettings &settings)
+    {
+        std::vector<std::string> requests;
+        {
+            std::ifstream input(settings.requests_path);
+            if (!input)
+            {
+                throw std::runtime_error("Can't open "s + settings.requests_path);
+            }
+            for (std::string line; std::getline(input, line);)
+            {
+                if (line.find_first_not_of(" \t\r"sv) != std::string::npos)
+                {
+                    requests.push_back(std::move(line));
+                }
+            }
+        }
+        if (requests.empty())
+        {
+            throw std::runtime_error("No requests in "s + settings.requests_path);
+        }
+
+        using Clock = std::chrono::steady_clock;
+        const size_t connections = std::max<size_t>(settings.connections, 1);
+        std::vector<std::vector<double>> latencies(connections);
+        std::vector<size_t> errors(connections, 0);
+        std::vector<std::thread> clients;
+
+        const auto start = Clock::now();
+        for (size_t c = 0; c < connections; ++c)
+        {
+            clients.emplace_back([&, c]
+                                 {
+                const size_t count = settings.requests / connections + (c < settings.requests % connections ? 1 : 0);
+                int fd = -1;
+                try
+                {
+                    fd = Connect(settings.endpoint);
+                }
+                catch (const std::exception &)
+                {
+                    errors[c] = count;
+                    return;
+                }
+                std::string buffer;
+                char chunk[READ_CHUNK];
+                latencies[c].reserve(count);
+                for (size_t i = 0; i < count; ++i)
+                {
+                    const std::string &request = requests[(c + i * connections) % requests.size()];
+                    const auto sent_at = Clock::now();
+                    try
+                    {
+                        SendAll(fd, request + "\n"s);
+                    }
+                    catch (const std::exception &)
+                    {
+                        close(fd);
+                        errors[c] += count - i;
+                        return;
+                    }
+                    size_t end;
+                    while ((end = buffer.find('\n')) == std::string::npos)
+                    {
+                        const ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+                        if (received <= 0)
+                        {
+                            close(fd);
+                            errors[c] += count - i;
+                            return;
+                        }
+                        buffer.append(chunk, static_cast<size_t>(received));
+                    }
+                    latencies[c].push_back(std::chrono::duration<double, std::milli>(Clock::now() - sent_at).count());
+                    if (buffer.compare(0, 16, "{\"error_message\"") == 0)
+                    {
+                        ++errors[c];
+                    }
+                    buffer.erase(0, end + 1);
+                }
+                close(fd); });
+        }
+        for (auto &client : clients)
+        {
+            client.join();
+        }
+
+        LoadTestResult result;
+        result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        std::vector<double> all;
+        for (size_t c = 0; c < connections; ++c)
+        {
+            all.insert(all.end(), latencies[c].begin(), latencies[c].end());
+            result.errors += errors[c];
+        }
+        result.requests = all.size();
+        if (!all.empty())
+        {
+            std::sort(all.begin(), all.end());
+            const auto percentile = [&all](double p)
+            {
+                return all[std::min(all.size() - 1, static_cast<size_t>(p * all.size()))];
+            };
+            result.p50_ms = percentile(0.50);
+            result.p99_ms = percentile(0.99);
+            result.max_ms = all.back();
+            result.requests_per_second = result.seconds > 0 ? all.size() / result.seconds : 0.0;
+        }
+        return result;
+    }
+
+}
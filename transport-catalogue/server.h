@@ -0,0 +1,140 @@
+#pragma once
+
+#include "thread_pool.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace transport_catalog::server
+{
+
+    // Адрес сервера: "unix:/path/to/socket" или "tcp:PORT" (только 127.0.0.1)
+    struct Endpoint
+    {
+        bool is_unix = true;
+        std::string path;
+        int port = 0;
+    };
+
+    // Бросает std::invalid_argument, если адрес записан неверно
+    Endpoint ParseEndpoint(std::string_view spec);
+
+    struct ServerSettings
+    {
+        Endpoint endpoint;
+        size_t workers = ThreadPool::DefaultThreadCount();
+        // Новые соединения сверх лимита получают ошибку и закрываются
+        size_t max_connections = 1024;
+        // Пока столько запросов обрабатывается, чтение из сокетов приостанавливается
+        size_t max_in_flight = 4096;
+        // Соединение с более длинной строкой запроса закрывается
+        size_t max_request_size = 1 << 24;
+    };
+
+    // Получает строку запроса без перевода строки и возвращает строку ответа
+    using RequestHandler = std::function<std::string(std::string_view)>;
+
+    /*
+     * Сервер с неблокирующим циклом событий на epoll.
+     * Запросы и ответы — строки JSON, разделённые '\n' (NDJSON).
+     * Запросы выполняются в пуле потоков, а ответы в каждом соединении
+     * отправляются в порядке поступления запросов
+     */
+    class Server
+    {
+    public:
+        Server(ServerSettings settings, RequestHandler handler);
+        Server(const Server &) = delete;
+        Server &operator=(const Server &) = delete;
+        ~Server();
+
+        // Обслуживает соединения до вызова Stop
+        void Run();
+        // Можно вызывать из любого потока и из обработчика сигнала
+        void Stop();
+
+    private:
+        struct Connection
+        {
+            int fd = -1;
+            std::string input;
+            std::string output;
+            size_t output_pos = 0;
+            uint64_t next_seq = 0;
+            uint64_t next_send = 0;
+            // Ответы, готовые раньше предыдущих
+            std::map<uint64_t, std::string> ready;
+            size_t in_flight = 0;
+            uint32_t events = 0;
+            bool read_closed = false;
+            bool paused = false;
+        };
+
+        struct Completion
+        {
+            uint64_t connection_id;
+            uint64_t seq;
+            std::string answer;
+        };
+
+        void Accept();
+        void Read(uint64_t id, Connection &connection);
+        void Dispatch(uint64_t id, Connection &connection);
+        void Write(uint64_t id, Connection &connection);
+        void DrainCompletions();
+        void UpdateEvents(uint64_t id, Connection &connection);
+        void Close(uint64_t id);
+
+        ServerSettings settings_;
+        RequestHandler handler_;
+        int epoll_fd_ = -1;
+        int listen_fd_ = -1;
+        int event_fd_ = -1;
+        std::atomic<bool> stopping_ = false;
+
+        uint64_t next_connection_id_;
+        std::unordered_map<uint64_t, Connection> connections_;
+        std::unordered_set<uint64_t> paused_;
+        size_t in_flight_ = 0;
+
+        std::mutex completions_mutex_;
+        std::vector<Completion> completions_;
+
+        // Задачи пула пишут в event_fd_, поэтому деструктор дожидается
+        // их завершения до закрытия дескрипторов
+        std::unique_ptr<ThreadPool> pool_;
+    };
+
+    struct LoadTestSettings
+    {
+        Endpoint endpoint;
+        // Файл со строками запросов; запросы посылаются по кругу
+        std::string requests_path;
+        size_t connections = 8;
+        size_t requests = 10000;
+    };
+
+    struct LoadTestResult
+    {
+        size_t requests = 0;
+        size_t errors = 0;
+        double seconds = 0.0;
+        double requests_per_second = 0.0;
+        double p50_ms = 0.0;
+        double p99_ms = 0.0;
+        double max_ms = 0.0;
+    };
+
+    // Нагрузочный клиент: каждое соединение посылает запрос и ждёт ответа
+    LoadTestResult RunLoadTest(const LoadTestSettings &settings);
+
+}
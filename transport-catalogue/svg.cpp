@@ -1,13 +1,44 @@
 #include "svg.h"
 #include <algorithm>
+#include <charconv>
 #include <string>
 #include <string_view>
+#include <type_traits>
 
 namespace svg
 {
 
     using namespace std::literals;
 
+    void RenderNumber(std::ostream &out, double value, int decimals)
+    {
+        // Хватает для любого double в фиксированном формате с MAX_DECIMALS знаками
+        char buffer[400];
+        if (decimals < 0)
+        {
+            // Совпадает с выводом ostream::operator<< при precision() == 6
+            const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value, std::chars_format::general, 6);
+            out.write(buffer, result.ptr - buffer);
+            return;
+        }
+        const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value, std::chars_format::fixed, std::min(decimals, MAX_DECIMALS));
+        std::string_view text(buffer, result.ptr - buffer);
+        if (text.find('.') != text.npos)
+        {
+            text.remove_suffix(text.size() - 1 - text.find_last_not_of('0'));
+            if (text.back() == '.')
+            {
+                text.remove_suffix(1);
+            }
+        }
+        // Отрицательные числа, округлённые до нуля, выводятся без знака
+        if (text == "-0"sv)
+        {
+            text.remove_prefix(1);
+        }
+        out.write(text.data(), text.size());
+    }
+
     void Object::Render(const RenderContext &context) const
     {
         context.RenderIndent();
@@ -15,7 +46,7 @@ namespace svg
         // Делегируем вывод тега своим подклассам
         RenderObject(context);
 
-        context.out << std::endl;
+        context.out.put('\n');
     }
 
     // ---------- Circle ------------------
@@ -35,8 +66,13 @@ namespace svg
     void Circle::RenderObject(const RenderContext &context) const
     {
         auto &out = context.out;
-        out << "<circle cx=\""sv << center_.x << "\" cy=\""sv << center_.y << "\" "sv;
-        out << "r=\""sv << radius_ << "\""sv;
+        out << "<circle cx=\""sv;
+        RenderNumber(out, center_.x);
+        out << "\" cy=\""sv;
+        RenderNumber(out, center_.y);
+        out << "\" r=\""sv;
+        RenderNumber(out, radius_);
+        out << "\""sv;
         RenderAttrs(context.out);
         out << "/>"sv;
     }
@@ -54,13 +90,14 @@ namespace svg
         bool is_first = true;
         for (const Point &point : points_)
         {
-            if (is_first)
+            if (!is_first)
             {
-                out << point.x << "," << point.y;
-                is_first = false;
-                continue;
+                out.put(' ');
             }
-            out << " " << point.x << "," << point.y;
+            is_first = false;
+            RenderNumber(out, point.x);
+            out.put(',');
+            RenderNumber(out, point.y);
         }
         out << "\"";
         RenderAttrs(context.out);
@@ -97,19 +134,53 @@ namespace svg
         return *this;
     }
 
-    Text &Text::SetData(std::string data)
+    namespace
     {
-        for (auto [ch, spec_ch] : spec_symbols_)
+        // Замена для спецсимволов XML, пустая строка для остальных
+        std::string_view SpecSymbol(char ch)
         {
-            auto founded_ch = data.find(ch);
-            while (founded_ch != std::string::npos)
+            switch (ch)
             {
-                data.replace(founded_ch, 1, spec_ch);
-                founded_ch = data.find(ch);
+            case '"':
+                return "&quot;"sv;
+            case '<':
+                return "&lt;"sv;
+            case '>':
+                return "&gt;"sv;
+            case '\'':
+                return "&apos;"sv;
+            case '&':
+                return "&amp;"sv;
+            default:
+                return {};
             }
         }
+    }
 
-        data_ = data;
+    Text &Text::SetData(std::string data)
+    {
+        // Текст без спецсимволов сохраняется как есть, иначе экранируется за один проход
+        const auto special = std::find_if(data.begin(), data.end(), [](char ch)
+                                          { return !SpecSymbol(ch).empty(); });
+        if (special == data.end())
+        {
+            data_ = std::move(data);
+            return *this;
+        }
+        data_.clear();
+        data_.reserve(data.size() + 16);
+        data_.append(data.begin(), special);
+        for (auto it = special; it != data.end(); ++it)
+        {
+            if (const auto spec_ch = SpecSymbol(*it); !spec_ch.empty())
+            {
+                data_ += spec_ch;
+            }
+            else
+            {
+                data_ += *it;
+            }
+        }
         return *this;
     }
 
@@ -118,8 +189,15 @@ namespace svg
         auto &out = context.out;
         out << "<text";
         RenderAttrs(context.out);
-        out << " x=\"" << pos_.x << "\" y=\"" << pos_.y << "\" ";
-        out << "dx=\"" << offset_.x << "\" dy=\"" << offset_.y << "\" ";
+        out << " x=\""sv;
+        RenderNumber(out, pos_.x);
+        out << "\" y=\""sv;
+        RenderNumber(out, pos_.y);
+        out << "\" dx=\""sv;
+        RenderNumber(out, offset_.x);
+        out << "\" dy=\""sv;
+        RenderNumber(out, offset_.y);
+        out << "\" "sv;
         out << "font-size=\"" << font_size_ << "\"";
 
         if (font_family_ != "")
@@ -139,25 +217,83 @@ namespace svg
         objects_.emplace_back(std::move(obj));
     }
 
+    void Document::AddObject(Circle obj)
+    {
+        objects_.emplace_back(std::move(obj));
+    }
+
+    void Document::AddObject(Polyline obj)
+    {
+        objects_.emplace_back(std::move(obj));
+    }
+
+    void Document::AddObject(Text obj)
+    {
+        objects_.emplace_back(std::move(obj));
+    }
+
+    void Document::Reserve(size_t count)
+    {
+        objects_.reserve(count);
+    }
+
+    void RenderDocumentBegin(std::ostream &out)
+    {
+        out << "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n\n"sv;
+        out << "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">\n"sv;
+    }
+
+    void RenderDocumentEnd(std::ostream &out)
+    {
+        out << "</svg>"sv;
+    }
+
+    void RenderEscapedText(std::ostream &out, std::string_view text)
+    {
+        size_t run_begin = 0;
+        for (size_t i = 0; i < text.size(); ++i)
+        {
+            if (const auto spec_ch = SpecSymbol(text[i]); !spec_ch.empty())
+            {
+                out << text.substr(run_begin, i - run_begin) << spec_ch;
+                run_begin = i + 1;
+            }
+        }
+        out << text.substr(run_begin);
+    }
+
     // Выводит в ostream svg-представление документа
     void Document::Render(std::ostream &out) const
     {
-        out << "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n"sv << std::endl;
-        out << "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">\n"sv;
+        RenderDocumentBegin(out);
 
         RenderContext contex(out, 2, 2);
-        for (auto &obj : objects_)
+        for (const auto &element : objects_)
         {
-            obj->Render(contex);
+            if (const auto *obj = std::get_if<std::unique_ptr<Object>>(&element))
+            {
+                (*obj)->Render(contex);
+                continue;
+            }
+            // Тип фигуры известен, виртуальный вызов не нужен
+            std::visit([&contex](const auto &obj)
+                       {
+                           if constexpr (!std::is_same_v<std::decay_t<decltype(obj)>, std::unique_ptr<Object>>)
+                           {
+                               contex.RenderIndent();
+                               obj.RenderObject(contex);
+                               contex.out.put('\n');
+                           } },
+                       element);
         }
-        out << "</svg>"sv;
+        RenderDocumentEnd(out);
     }
 
     void OstreamColorPrinter::operator()(std::monostate) const
     {
         out << "none";
     }
-    void OstreamColorPrinter::operator()(std::string color) const
+    void OstreamColorPrinter::operator()(const std::string &color) const
     {
         out << color;
     }
@@ -169,7 +305,9 @@ namespace svg
     void OstreamColorPrinter::operator()(Rgba color) const
     {
         out << "rgba(" << static_cast<int>(color.red) << "," << static_cast<int>(color.green)
-            << "," << static_cast<int>(color.blue) << "," << color.opacity << ")";
+            << "," << static_cast<int>(color.blue) << ",";
+        RenderNumber(out, color.opacity);
+        out << ")";
     }
 
     std::ostream &operator<<(std::ostream &out, Color color)
@@ -4,10 +4,8 @@
 #include <iostream>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <list>
-#include <memory>
-#include <unordered_map>
 #include <variant>
 #include <cstdint>
 #include <optional>
@@ -26,6 +24,14 @@ namespace svg
         double y = 0.0;
     };
 
+    // Число выводится так же, как ostream::operator<< по умолчанию: 6 значащих цифр
+    inline constexpr int AUTO_DECIMALS = -1;
+    inline constexpr int MAX_DECIMALS = 17;
+
+    // Выводит число без учёта локали через std::to_chars. С decimals >= 0 выводится
+    // не больше decimals знаков после запятой, конечные нули отбрасываются
+    void RenderNumber(std::ostream &out, double value, int decimals = AUTO_DECIMALS);
+
     /*
      * Вспомогательная структура, хранящая контекст для вывода SVG-документа с отступами.
      * Хранит ссылку на поток вывода, текущее значение и шаг отступа при выводе элемента
@@ -167,7 +173,7 @@ namespace svg
         std::ostream &out;
 
         void operator()(std::monostate) const;
-        void operator()(std::string color) const;
+        void operator()(const std::string &color) const;
         void operator()(Rgb color) const;
         void operator()(Rgba color) const;
     };
@@ -236,7 +242,9 @@ namespace svg
             }
             if (stroke_width_)
             {
-                out << " stroke-width=\""sv << *stroke_width_ << "\""sv;
+                out << " stroke-width=\""sv;
+                RenderNumber(out, *stroke_width_);
+                out << "\""sv;
             }
             if (stroke_linecap_)
             {
@@ -274,6 +282,8 @@ namespace svg
         Circle &SetRadius(double radius);
 
     private:
+        friend class Document;
+
         void RenderObject(const RenderContext &context) const override;
 
         Point center_;
@@ -284,23 +294,24 @@ namespace svg
      * Класс Polyline моделирует элемент <polyline> для отображения ломаных линий
      * https://developer.mozilla.org/en-US/docs/Web/SVG/Element/polyline
      */
-    class Polyline : public Object, public PathProps<Polyline>
+    class Polyline final : public Object, public PathProps<Polyline>
     {
     public:
         // Добавляет очередную вершину к ломаной линии
         Polyline &AddPoint(Point point);
 
     private:
+        friend class Document;
         void RenderObject(const RenderContext &context) const override;
 
-        std::list<Point> points_;
+        std::vector<Point> points_;
     };
 
     /*
      * Класс Text моделирует элемент <text> для отображения текста
      * https://developer.mozilla.org/en-US/docs/Web/SVG/Element/text
      */
-    class Text : public Object, public PathProps<Text>
+    class Text final : public Object, public PathProps<Text>
     {
     public:
         // Задаёт координаты опорной точки (атрибуты x и y)
@@ -322,6 +333,7 @@ namespace svg
         Text &SetData(std::string data);
 
     private:
+        friend class Document;
         void RenderObject(const RenderContext &context) const override;
 
         Point pos_ = {0.0, 0.0};
@@ -330,12 +342,6 @@ namespace svg
         std::string font_family_;
         std::string font_weight_;
         std::string data_ = "";
-        std::unordered_map<char, std::string> spec_symbols_ = {
-            {'\"', "&quot;"},
-            {'<', "&lt;"},
-            {'>', "&gt;"},
-            {'\'', "&apos;"},
-            {'&', "&amp;"}};
     };
 
     class ObjectContainer
@@ -346,26 +352,67 @@ namespace svg
         template <typename Obj>
         void Add(Obj obj)
         {
-            AddPtr(std::make_unique<Obj>(std::move(obj)));
+            AddObject(std::move(obj));
         }
 
     protected:
         ~ObjectContainer() = default;
+
+        // Стандартные фигуры контейнер может хранить по значению,
+        // по умолчанию они, как и прочие объекты, передаются в AddPtr
+        virtual void AddObject(Circle obj)
+        {
+            AddPtr(std::make_unique<Circle>(std::move(obj)));
+        }
+        virtual void AddObject(Polyline obj)
+        {
+            AddPtr(std::make_unique<Polyline>(std::move(obj)));
+        }
+        virtual void AddObject(Text obj)
+        {
+            AddPtr(std::make_unique<Text>(std::move(obj)));
+        }
+        template <typename Obj>
+        void AddObject(Obj obj)
+        {
+            AddPtr(std::make_unique<Obj>(std::move(obj)));
+        }
     };
 
+    /*
+     * Объекты документа хранятся подряд в одном массиве: стандартные фигуры —
+     * по значению, прочие наследники Object — через указатель.
+     * Вывод документа — один проход по массиву
+     */
     class Document : public ObjectContainer
     {
     public:
         // Добавляет в svg-документ объект-наследник svg::Object
         void AddPtr(std::unique_ptr<Object> &&obj) override;
 
+        // Резервирует место под count объектов
+        void Reserve(size_t count);
+
         // Выводит в ostream svg-представление документа
         void Render(std::ostream &out) const;
 
+    protected:
+        void AddObject(Circle obj) override;
+        void AddObject(Polyline obj) override;
+        void AddObject(Text obj) override;
+
     private:
-        std::list<std::unique_ptr<Object>> objects_;
+        using Element = std::variant<Circle, Polyline, Text, std::unique_ptr<Object>>;
+        std::vector<Element> objects_;
     };
 
+    // Выводит текст, заменяя спецсимволы XML на сущности
+    void RenderEscapedText(std::ostream &out, std::string_view text);
+
+    // Заголовок и окончание SVG-документа для вывода элементов без svg::Document
+    void RenderDocumentBegin(std::ostream &out);
+    void RenderDocumentEnd(std::ostream &out);
+
     class Drawable
     {
     public:
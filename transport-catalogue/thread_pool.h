@@ -0,0 +1,304 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace transport_catalog
+{
+
+    // Полоса очереди пула. Задачи полосы Latency берутся первыми, а задачи
+    // Throughput занимают не больше Size() - 1 потоков, чтобы короткие задачи
+    // не ждали окончания тяжёлых
+    enum class Lane
+    {
+        Latency,
+        Throughput,
+    };
+
+    // Состояние полосы на момент запроса
+    struct LaneStats
+    {
+        size_t queued = 0;
+        size_t running = 0;
+        size_t completed = 0;
+        // Время от постановки задачи в очередь до её завершения
+        std::chrono::microseconds total_latency{0};
+        std::chrono::microseconds max_latency{0};
+    };
+
+    /*
+     * Пул потоков фиксированного размера с очередями двух полос.
+     * Деструктор дожидается выполнения всех поставленных задач
+     */
+    class ThreadPool
+    {
+    public:
+        explicit ThreadPool(size_t threads = DefaultThreadCount())
+        {
+            threads = std::max<size_t>(threads, 1);
+            throughput_limit_ = std::max<size_t>(threads, 2) - 1;
+            workers_.reserve(threads);
+            for (size_t i = 0; i < threads; ++i)
+            {
+                workers_.emplace_back([this]
+                                      { Work(); });
+            }
+        }
+
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        ~ThreadPool()
+        {
+            {
+                std::lock_guard lock(mutex_);
+                stopping_ = true;
+            }
+            has_task_.notify_all();
+            for (auto &worker : workers_)
+            {
+                worker.join();
+            }
+        }
+
+        static size_t DefaultThreadCount()
+        {
+            return std::max<unsigned>(std::thread::hardware_concurrency(), 1);
+        }
+
+        size_t Size() const
+        {
+            return workers_.size();
+        }
+
+        void Post(std::function<void()> task, Lane lane = Lane::Latency)
+        {
+            {
+                std::lock_guard lock(mutex_);
+                lanes_[static_cast<size_t>(lane)].tasks.push_back({std::move(task), Clock::now()});
+            }
+            has_task_.notify_one();
+        }
+
+        // Ставит задачу в очередь и возвращает future с её результатом
+        template <typename Task>
+        auto Submit(Task task, Lane lane = Lane::Latency) -> std::future<std::invoke_result_t<Task>>
+        {
+            using Result = std::invoke_result_t<Task>;
+            auto packaged = std::make_shared<std::packaged_task<Result()>>(std::move(task));
+            auto result = packaged->get_future();
+            Post([packaged]
+                 { (*packaged)(); },
+                 lane);
+            return result;
+        }
+
+        LaneStats Stats(Lane lane) const
+        {
+            std::lock_guard lock(mutex_);
+            const auto &state = lanes_[static_cast<size_t>(lane)];
+            LaneStats stats = state.stats;
+            stats.queued = state.tasks.size();
+            return stats;
+        }
+
+        // Делит диапазон [0, count) на части не меньше grain и обрабатывает их
+        // вызовами func(begin, end) в пуле, дожидаясь завершения всех частей.
+        // Вызывающий поток сам разбирает части вместе с потоками пула, поэтому
+        // функцию можно вызывать и из задач этого же пула
+        template <typename Func>
+        void ParallelFor(size_t count, size_t grain, Func func)
+        {
+            const size_t chunks = std::min(Size() * 4, count / std::max<size_t>(grain, 1));
+            if (Size() == 1 || chunks <= 1)
+            {
+                if (count > 0)
+                {
+                    func(size_t{0}, count);
+                }
+                return;
+            }
+
+            struct State
+            {
+                std::atomic<size_t> next{0};
+                size_t done = 0;
+                std::exception_ptr error;
+                std::mutex mutex;
+                std::condition_variable all_done;
+            };
+            // Помощник, запущенный после разбора всех частей, сразу завершается
+            // и к func не обращается, поэтому может пережить этот вызов
+            const auto state = std::make_shared<State>();
+            const auto work = [state, &func, count, chunks]
+            {
+                for (size_t i; (i = state->next.fetch_add(1)) < chunks;)
+                {
+                    std::exception_ptr error;
+                    try
+                    {
+                        func(count * i / chunks, count * (i + 1) / chunks);
+                    }
+                    catch (...)
+                    {
+                        error = std::current_exception();
+                    }
+                    std::lock_guard lock(state->mutex);
+                    if (error && !state->error)
+                    {
+                        state->error = error;
+                    }
+                    if (++state->done == chunks)
+                    {
+                        state->all_done.notify_all();
+                    }
+                }
+            };
+            for (size_t i = 1; i < std::min(chunks, Size()); ++i)
+            {
+                Post(work);
+            }
+            work();
+
+            std::unique_lock lock(state->mutex);
+            state->all_done.wait(lock, [&state, chunks]
+                                 { return state->done == chunks; });
+            if (state->error)
+            {
+                std::rethrow_exception(state->error);
+            }
+        }
+
+        // Сортирует части диапазона параллельно, затем попарно сливает их
+        template <typename RandomIt, typename Compare>
+        void ParallelSort(RandomIt first, RandomIt last, Compare comp)
+        {
+            constexpr size_t SORT_GRAIN = 1 << 14;
+            const size_t count = static_cast<size_t>(last - first);
+            const size_t parts = std::min(Size(), count / SORT_GRAIN);
+            if (parts <= 1)
+            {
+                std::sort(first, last, comp);
+                return;
+            }
+            std::vector<size_t> bounds(parts + 1);
+            for (size_t i = 0; i <= parts; ++i)
+            {
+                bounds[i] = count * i / parts;
+            }
+            ParallelFor(parts, 1, [&](size_t begin, size_t end)
+                        {
+                            for (size_t i = begin; i < end; ++i)
+                            {
+                                std::sort(first + bounds[i], first + bounds[i + 1], comp);
+                            } });
+            while (bounds.size() > 2)
+            {
+                const size_t pairs = (bounds.size() - 1) / 2;
+                ParallelFor(pairs, 1, [&](size_t begin, size_t end)
+                            {
+                                for (size_t i = begin; i < end; ++i)
+                                {
+                                    std::inplace_merge(first + bounds[2 * i], first + bounds[2 * i + 1], first + bounds[2 * i + 2], comp);
+                                } });
+                std::vector<size_t> merged;
+                merged.reserve(pairs + 2);
+                for (size_t i = 0; i < bounds.size(); i += 2)
+                {
+                    merged.push_back(bounds[i]);
+                }
+                if (merged.back() != bounds.back())
+                {
+                    merged.push_back(bounds.back());
+                }
+                bounds = std::move(merged);
+            }
+        }
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        struct Task
+        {
+            std::function<void()> run;
+            Clock::time_point queued_at;
+        };
+
+        struct LaneState
+        {
+            std::deque<Task> tasks;
+            LaneStats stats;
+        };
+
+        // Полоса, из которой можно взять задачу, или nullptr
+        LaneState *ReadyLane()
+        {
+            auto &latency = lanes_[static_cast<size_t>(Lane::Latency)];
+            if (!latency.tasks.empty())
+            {
+                return &latency;
+            }
+            auto &throughput = lanes_[static_cast<size_t>(Lane::Throughput)];
+            if (!throughput.tasks.empty() && throughput.stats.running < throughput_limit_)
+            {
+                return &throughput;
+            }
+            return nullptr;
+        }
+
+        void Work()
+        {
+            while (true)
+            {
+                LaneState *lane = nullptr;
+                Task task;
+                {
+                    std::unique_lock lock(mutex_);
+                    has_task_.wait(lock, [this, &lane]
+                                   {
+                                       lane = ReadyLane();
+                                       return lane != nullptr || (stopping_ && lanes_[0].tasks.empty() && lanes_[1].tasks.empty()); });
+                    if (lane == nullptr)
+                    {
+                        return;
+                    }
+                    task = std::move(lane->tasks.front());
+                    lane->tasks.pop_front();
+                    ++lane->stats.running;
+                }
+                task.run();
+                const auto latency = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - task.queued_at);
+                {
+                    std::lock_guard lock(mutex_);
+                    --lane->stats.running;
+                    ++lane->stats.completed;
+                    lane->stats.total_latency += latency;
+                    lane->stats.max_latency = std::max(lane->stats.max_latency, latency);
+                }
+                // Освободилось место для задачи полосы Throughput
+                has_task_.notify_one();
+            }
+        }
+
+        std::vector<std::thread> workers_;
+        // Сколько потоков одновременно могут выполнять задачи полосы Throughput
+        size_t throughput_limit_ = 1;
+        LaneState lanes_[2];
+        mutable std::mutex mutex_;
+        std::condition_variable has_task_;
+        bool stopping_ = false;
+    };
+
+}
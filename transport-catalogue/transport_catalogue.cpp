@@ -1,12 +1,15 @@
 #include "transport_catalogue.h"
 #include <iostream>
+#include <algorithm>
 #include <unordered_set>
 namespace transport_catalog
 {
     void TransportCatalogue::AddStop(Stop &stop)
     {
+        stop.id = stops_.size();
         stops_.push_back(std::move(stop));
         dictStops_[stops_.back().name] = &stops_.back();
+        ++version_;
     }
 
     void TransportCatalogue::AddBus(Bus &bus)
@@ -14,11 +17,67 @@ namespace transport_catalog
         buses_.push_back(std::move(bus));
         auto &buff = buses_.back();
         dictBuses_[buff.name] = &buff;
+        ++version_;
         for (const auto *tmp : buff.stops)
         {
             stopToBuses_[tmp->name].insert(buff.name);
         }
     }
+    void TransportCatalogue::AddStops(std::vector<Stop> &stops)
+    {
+        dictStops_.reserve(dictStops_.size() + stops.size());
+        for (auto &stop : stops)
+        {
+            AddStop(stop);
+        }
+    }
+
+    void TransportCatalogue::AddBuses(std::vector<Bus> &buses, ThreadPool &pool)
+    {
+        const size_t first = buses_.size();
+        dictBuses_.reserve(dictBuses_.size() + buses.size());
+        // Offsets of each bus' stops in links are prefix sums of the route lengths
+        std::vector<size_t> offsets(buses.size() + 1, 0);
+        for (size_t i = 0; i < buses.size(); ++i)
+        {
+            offsets[i + 1] = offsets[i] + buses[i].stops.size();
+            buses_.push_back(std::move(buses[i]));
+            dictBuses_[buses_.back().name] = &buses_.back();
+            ++version_;
+        }
+
+        using Link = std::pair<const Stop *, std::string_view>;
+        std::vector<Link> links(offsets.back());
+        pool.ParallelFor(buses.size(), 64, [&](size_t begin, size_t end)
+                         {
+                             for (size_t i = begin; i < end; ++i)
+                             {
+                                 const Bus &bus = buses_[first + i];
+                                 std::transform(bus.stops.begin(), bus.stops.end(), links.begin() + offsets[i],
+                                                [&bus](const Stop *stop)
+                                                { return Link{stop, bus.name}; });
+                             } });
+        pool.ParallelSort(links.begin(), links.end(), [](const Link &lhs, const Link &rhs)
+                          {
+                              if (lhs.first != rhs.first)
+                              {
+                                  return std::less<const Stop *>{}(lhs.first, rhs.first);
+                              }
+                              return lhs.second < rhs.second; });
+
+        for (auto group = links.begin(); group != links.end();)
+        {
+            auto &stop_buses = stopToBuses_[group->first->name];
+            auto it = group;
+            for (; it != links.end() && it->first == group->first; ++it)
+            {
+                stop_buses.insert(stop_buses.end(), it->second);
+            }
+            group = it;
+        }
+        buses.clear();
+    }
+
     std::vector<const Bus *> TransportCatalogue::GetBusesVector() const
     {
         std::vector<const Bus *> buses;
@@ -57,16 +116,35 @@ namespace transport_catalog
 
     bool TransportCatalogue::AddDistances(std::string_view stop, std::string_view to_stop, size_t ste_meter)
     {
-        const Stop *fstop = FindStop(stop), *sstop = FindStop(to_stop);
-        if (*fstop == Stop{} || *sstop == Stop{})
+        return AddDistances(FindStop(stop), FindStop(to_stop), ste_meter);
+    }
+
+    bool TransportCatalogue::AddDistances(const Stop *stop, const Stop *to_stop, size_t ste_meter)
+    {
+        if (*stop == Stop{} || *to_stop == Stop{})
         {
             return false;
         }
-        RelationStopToStop x{fstop, sstop};
+        RelationStopToStop x{stop, to_stop};
         distancesToStops_.insert_or_assign(x, ste_meter);
         return true;
     }
 
+    void TransportCatalogue::ReserveDistances(size_t count)
+    {
+        distancesToStops_.reserve(distancesToStops_.size() + count);
+    }
+
+    uint64_t TransportCatalogue::GetVersion() const
+    {
+        return version_;
+    }
+
+    size_t TransportCatalogue::GetStopCount() const
+    {
+        return stops_.size();
+    }
+
     StopOut TransportCatalogue::GetStopInfo(std::string_view name) const
     {
         const Stop *stop = FindStop(name);
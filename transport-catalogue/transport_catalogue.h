@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <string>
 #include <deque>
 #include <string_view>
@@ -6,6 +7,7 @@
 #include <set>
 #include <vector>
 #include "domain.h"
+#include "thread_pool.h"
 namespace transport_catalog
 {
 
@@ -23,11 +25,20 @@ namespace transport_catalog
         std::unordered_map<std::string_view, std::set<std::string_view>> stopToBuses_;
         // Calculated distance stop to stop
         std::unordered_map<RelationStopToStop, size_t, RelationStopToStopHasher> distancesToStops_;
+        // Increases on every change of stops or buses
+        uint64_t version_ = 0;
 
     public:
         void AddStop(Stop &stop);
         bool AddDistances(std::string_view stop, std::string_view to_stop, size_t ste_meter);
+        bool AddDistances(const Stop *stop, const Stop *to_stop, size_t ste_meter);
+        // Reserves space for the expected number of stop-to-stop distances
+        void ReserveDistances(size_t count);
         void AddBus(Bus &bus);
+        // Bulk loading. The result is the same as adding the elements one by one in order;
+        // the stop to bus index is built with a parallel sort and group in pool
+        void AddStops(std::vector<Stop> &stops);
+        void AddBuses(std::vector<Bus> &buses, ThreadPool &pool);
         std::vector<const Bus *> GetBusesVector() const;
         const std::unordered_map<std::string_view, const Stop *> &GetAllStop() const;
         const std::unordered_map<std::string_view, const Bus *> &GetAllBus() const;
@@ -35,6 +46,11 @@ namespace transport_catalog
         const Stop *FindStop(std::string_view name) const;
         const Bus *FindBus(std::string_view name) const;
 
+        // Version of the stop and bus set, used to invalidate derived caches
+        uint64_t GetVersion() const;
+        // Stop ids are 0 .. GetStopCount() - 1
+        size_t GetStopCount() const;
+
         BusOut GetBusInfo(std::string_view name) const;
         StopOut GetStopInfo(std::string_view name) const;
     };